@@ -32,11 +32,17 @@
 
 #include "Descriptors.h"
 
+#define LAYOUTS_CONTROLS_ONLY   // Just the Consumer usages.
+#include "Layouts.h"
+
 /** HID class report descriptor. This is a special descriptor constructed with values from the
  *  USBIF HID class specification to describe the reports and capabilities of the HID device. This
  *  descriptor is parsed by the host and its contents used to determine what data (and in what encoding)
  *  the device will send, and what it may be sent back from the host. Refer to the HID specification for
  *  more details on HID report descriptors.
+ *
+ *  This describes the report protocol, which uses report IDs. In boot protocol, the host ignores
+ *  it and the device sends the standard 8-byte boot keyboard report instead.
  */
 const USB_Descriptor_HIDReport_Datatype_t PROGMEM KeyboardReport[] =
 {
@@ -49,6 +55,7 @@ const USB_Descriptor_HIDReport_Datatype_t PROGMEM KeyboardReport[] =
   HID_RI_USAGE_PAGE(8, 0x01),
   HID_RI_USAGE(8, 0x06),
   HID_RI_COLLECTION(8, 0x01),
+  HID_RI_REPORT_ID(8, REPORT_ID_Keyboard),
   HID_RI_USAGE_PAGE(8, 0x07),
   HID_RI_USAGE_MINIMUM(8, 0xE0),
   HID_RI_USAGE_MAXIMUM(8, 0xE7),
@@ -57,9 +64,11 @@ const USB_Descriptor_HIDReport_Datatype_t PROGMEM KeyboardReport[] =
   HID_RI_REPORT_SIZE(8, 0x01),
   HID_RI_REPORT_COUNT(8, 0x08),
   HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+#if !KEYBOARD_NKRO
   HID_RI_REPORT_COUNT(8, 0x01),
   HID_RI_REPORT_SIZE(8, 0x08),
   HID_RI_INPUT(8, HID_IOF_CONSTANT),
+#endif
   HID_RI_USAGE_PAGE(8, 0x08),
   HID_RI_USAGE_MINIMUM(8, 0x01),
   HID_RI_USAGE_MAXIMUM(8, 0x05),
@@ -69,6 +78,15 @@ const USB_Descriptor_HIDReport_Datatype_t PROGMEM KeyboardReport[] =
   HID_RI_REPORT_COUNT(8, 0x01),
   HID_RI_REPORT_SIZE(8, 0x03),
   HID_RI_OUTPUT(8, HID_IOF_CONSTANT),
+#if KEYBOARD_NKRO
+  /* One bit per key usage, so that any number of keys can be down. */
+  HID_RI_USAGE_PAGE(8, 0x07),
+  HID_RI_USAGE_MINIMUM(8, 0x00),
+  HID_RI_USAGE_MAXIMUM(8, KEYBOARD_NKRO_USAGES - 1),
+  HID_RI_REPORT_COUNT(8, KEYBOARD_NKRO_USAGES),
+  HID_RI_REPORT_SIZE(8, 0x01),
+  HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+#else
   HID_RI_LOGICAL_MINIMUM(8, 0x00),
   HID_RI_LOGICAL_MAXIMUM(8, 0xFF),
   HID_RI_USAGE_PAGE(8, 0x07),
@@ -77,13 +95,70 @@ const USB_Descriptor_HIDReport_Datatype_t PROGMEM KeyboardReport[] =
   HID_RI_REPORT_COUNT(8, 6),
   HID_RI_REPORT_SIZE(8, 0x08),
   HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+#endif
+  HID_RI_REPORT_ID(8, REPORT_ID_Settings),
   HID_RI_USAGE_PAGE(16, 0xFF00),
+  HID_RI_LOGICAL_MINIMUM(8, 0x00),
+  HID_RI_LOGICAL_MAXIMUM(8, 0xFF),
   HID_RI_REPORT_COUNT(8, 0x01),
   HID_RI_REPORT_SIZE(8, 0x08),
   HID_RI_USAGE(8, 0x01),
   HID_RI_FEATURE(8, HID_IOF_CONSTANT | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
   HID_RI_USAGE(8, 0x02),
   HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+  HID_RI_USAGE(8, 0x03),
+  HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+  HID_RI_USAGE(8, 0x08),
+  HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+  /* Latency histogram; setting it clears it. */
+  HID_RI_REPORT_ID(8, REPORT_ID_Latency),
+  HID_RI_REPORT_COUNT(8, sizeof(USB_LatencyReport_Data_t)),
+  HID_RI_USAGE(8, 0x04),
+  HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+  /* Counters; setting them clears them. */
+  HID_RI_REPORT_ID(8, REPORT_ID_Stats),
+  HID_RI_REPORT_COUNT(8, sizeof(USB_StatsReport_Data_t)),
+  HID_RI_USAGE(8, 0x05),
+  HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+  /* Key remap and macro tables, uploaded in pieces; see TableCommands_t. */
+  HID_RI_REPORT_ID(8, REPORT_ID_Remap),
+  HID_RI_REPORT_COUNT(8, sizeof(USB_TableReport_Data_t)),
+  HID_RI_USAGE(8, 0x06),
+  HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+  HID_RI_REPORT_ID(8, REPORT_ID_Macros),
+  HID_RI_REPORT_COUNT(8, sizeof(USB_TableReport_Data_t)),
+  HID_RI_USAGE(8, 0x07),
+  HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+  HID_RI_END_COLLECTION(0),
+  /* Function cluster keys: one bit per Consumer page usage. */
+  HID_RI_USAGE_PAGE(8, 0x0C),
+  HID_RI_USAGE(8, 0x01),
+  HID_RI_COLLECTION(8, 0x01),
+  HID_RI_REPORT_ID(8, REPORT_ID_Consumer),
+  CONSUMER_CONTROL_USAGES
+  HID_RI_LOGICAL_MINIMUM(8, 0x00),
+  HID_RI_LOGICAL_MAXIMUM(8, 0x01),
+  HID_RI_REPORT_COUNT(8, CONSUMER_CONTROL_COUNT),
+  HID_RI_REPORT_SIZE(8, 0x01),
+  HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+#if CONSUMER_CONTROL_COUNT < 16
+  HID_RI_REPORT_COUNT(8, 0x01),
+  HID_RI_REPORT_SIZE(8, 16 - CONSUMER_CONTROL_COUNT),
+  HID_RI_INPUT(8, HID_IOF_CONSTANT),
+#endif
+  HID_RI_END_COLLECTION(0),
+  /* Power key: the one System Control usage down, or 0 for none. */
+  HID_RI_USAGE_PAGE(8, 0x01),
+  HID_RI_USAGE(8, 0x80),
+  HID_RI_COLLECTION(8, 0x01),
+  HID_RI_REPORT_ID(8, REPORT_ID_SystemControl),
+  HID_RI_USAGE_MINIMUM(8, SYSTEM_CONTROL_POWER_DOWN),
+  HID_RI_USAGE_MAXIMUM(8, SYSTEM_CONTROL_WAKE_UP),
+  HID_RI_LOGICAL_MINIMUM(16, SYSTEM_CONTROL_POWER_DOWN),
+  HID_RI_LOGICAL_MAXIMUM(16, SYSTEM_CONTROL_WAKE_UP),
+  HID_RI_REPORT_COUNT(8, 0x01),
+  HID_RI_REPORT_SIZE(8, 0x08),
+  HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
   HID_RI_END_COLLECTION(0)
 #endif
 };
@@ -132,7 +207,7 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
       .ConfigurationNumber    = 1,
       .ConfigurationStrIndex  = NO_DESCRIPTOR,
 
-      .ConfigAttributes       = (USB_CONFIG_ATTR_RESERVED | USB_CONFIG_ATTR_SELFPOWERED),
+      .ConfigAttributes       = (USB_CONFIG_ATTR_RESERVED | USB_CONFIG_ATTR_SELFPOWERED | USB_CONFIG_ATTR_REMOTEWAKEUP),
 
       .MaxPowerConsumption    = USB_CONFIG_POWER_MA(100)
     },
@@ -171,10 +246,24 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
       .EndpointAddress        = KEYBOARD_EPADDR,
       .Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
       .EndpointSize           = KEYBOARD_EPSIZE,
-      .PollingIntervalMS      = 0x05
+      .PollingIntervalMS      = KEYBOARD_POLLING_INTERVAL
     },
 };
 
+/** Copy of the configuration descriptor in RAM, which is what is actually given to the host, so that the
+ *  polling interval can be chosen at run time.
+ */
+static USB_Descriptor_Configuration_t ConfigurationDescriptorRAM;
+
+/** Sets the polling interval of the Keyboard HID reporting IN endpoint. This takes effect when the host next
+ *  reads the configuration descriptor, so the device has to be reattached.
+ */
+void SetKeyboardPollingInterval(const uint8_t PollingIntervalMS)
+{
+  memcpy_P(&ConfigurationDescriptorRAM, &ConfigurationDescriptor, sizeof(USB_Descriptor_Configuration_t));
+  ConfigurationDescriptorRAM.HID_ReportINEndpoint.PollingIntervalMS = PollingIntervalMS;
+}
+
 /** Language descriptor structure. This descriptor, located in FLASH memory, is returned when the host requests
  *  the string descriptor with index 0 (the first index). It is actually an array of 16-bit integers, which indicate
  *  via the language ID table available at USB.org what languages the device supports for its string descriptors.
@@ -201,13 +290,15 @@ const USB_Descriptor_String_t PROGMEM ProductString = USB_STRING_DESCRIPTOR(L"Su
  */
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
                                     const uint16_t wIndex,
-                                    const void** const DescriptorAddress)
+                                    const void** const DescriptorAddress,
+                                    uint8_t* const DescriptorMemorySpace)
 {
   const uint8_t  DescriptorType   = (wValue >> 8);
   const uint8_t  DescriptorNumber = (wValue & 0xFF);
 
   const void* Address = NULL;
   uint16_t    Size    = NO_DESCRIPTOR;
+  uint8_t     Space   = MEMSPACE_FLASH;
 
   switch (DescriptorType)
   {
@@ -216,8 +307,9 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
       Size    = sizeof(USB_Descriptor_Device_t);
       break;
     case DTYPE_Configuration:
-      Address = &ConfigurationDescriptor;
+      Address = &ConfigurationDescriptorRAM;
       Size    = sizeof(USB_Descriptor_Configuration_t);
+      Space   = MEMSPACE_RAM;
       break;
     case DTYPE_String:
       switch (DescriptorNumber)
@@ -247,6 +339,7 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
       break;
   }
 
-  *DescriptorAddress = Address;
+  *DescriptorAddress     = Address;
+  *DescriptorMemorySpace = Space;
   return Size;
 }
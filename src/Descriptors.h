@@ -36,6 +36,8 @@
 
 #include <LUFA/Drivers/USB/USB.h>
 
+#include "SunKbd.h"
+
 /* Type Defines: */
 /** Type define for the device configuration descriptor
 *  structure. This must be defined in the application code, as the
@@ -73,17 +75,92 @@ enum StringDescriptors_t
   STRING_ID_Product      = 2, /**< Product string ID */
 };
 
+/** Enum for the HID report IDs used in report protocol. In boot protocol, only the keyboard
+*  report is sent and it has no ID.
+*/
+enum ReportIDs_t
+{
+  REPORT_ID_Keyboard      = 1, /**< Keyboard input and LED output report ID */
+  REPORT_ID_Settings      = 2, /**< Layout, click, polling interval and tap time feature report ID */
+  REPORT_ID_Latency       = 3, /**< Keystroke latency histogram feature report ID */
+  REPORT_ID_Stats         = 4, /**< Health and throughput counters feature report ID */
+  REPORT_ID_SystemControl = 5, /**< Power key System Control input report ID */
+  REPORT_ID_Consumer      = 6, /**< Function cluster Consumer page input report ID */
+  REPORT_ID_Remap         = 7, /**< Key remap table upload feature report ID */
+  REPORT_ID_Macros        = 8, /**< Macro table upload feature report ID */
+};
+
+/** Enum for the commands in a table feature report from the host. */
+enum TableCommands_t
+{
+  TABLE_COMMAND_Begin = 1, /**< Start a new table, all zero */
+  TABLE_COMMAND_Load  = 2, /**< Load the piece into the new table */
+  TABLE_COMMAND_Swap  = 3, /**< Put the new table in use, once it is all loaded */
+  TABLE_COMMAND_Read  = 4, /**< Give the piece in use from Offset when the report is read */
+};
+
+/** Type define for the remap and macro feature reports. */
+typedef struct
+{
+  uint8_t Command;                 /**< One of TABLE_COMMAND_*; always Read when read */
+  uint8_t Offset;                  /**< Offset of the piece in the table, a multiple of TABLE_PIECE_SIZE */
+  uint8_t Piece[TABLE_PIECE_SIZE]; /**< Bytes of the table */
+} ATTR_PACKED USB_TableReport_Data_t;
+
+/** Type define for the latency feature report. */
+typedef struct
+{
+  uint8_t        TickMicroseconds; /**< Length of a timer tick */
+  Latency_Data_t Latency;          /**< Histogram in timer ticks */
+} ATTR_PACKED USB_LatencyReport_Data_t;
+
+/** Type define for the counters feature report. */
+typedef struct
+{
+  uint8_t  TickMicroseconds;  /**< Length of a timer tick */
+  uint32_t BytesReceived;     /**< Bytes from the keyboard */
+  uint16_t FramingErrors;     /**< Bytes received with a framing error */
+  uint16_t Overruns;          /**< Bytes lost because the USART data register was overrun */
+  uint16_t RxDropped;         /**< Bytes lost because the receive buffer was full */
+  uint16_t RepeatedPresses;   /**< Presses of keys already down */
+  uint16_t UnmatchedReleases; /**< Releases of keys not down */
+  uint16_t RolloverEvents;    /**< Times the six-key array rolled over */
+  uint32_t ReportsSent;       /**< Queued reports sent to the host */
+  uint16_t ReportsSuppressed; /**< Reports not queued as unchanged */
+  uint16_t QueueOverflows;    /**< Report changes merged for a full queue */
+  uint16_t TxQueued;          /**< Commands queued for the keyboard */
+  uint16_t TxCoalesced;       /**< Commands replaced or dropped before being sent */
+  uint16_t MaxLoopTicks;      /**< Longest pass of the main loop */
+  uint16_t KeyboardLosses;    /**< Times the keyboard was unplugged or stopped answering */
+  uint16_t BytesQuarantined;  /**< Bytes ignored because they could not be trusted */
+  uint16_t DutyCycle;         /**< Thousandths of the last second the CPU was awake */
+  uint16_t MaxDutyCycle;      /**< Most of any second */
+  uint16_t PressesDropped;    /**< Presses dropped because the key state was full */
+} ATTR_PACKED USB_StatsReport_Data_t;
+
 /* Macros: */
+/** Default polling interval in milliseconds of the Keyboard HID reporting IN endpoint. */
+#ifndef KEYBOARD_POLLING_INTERVAL
+#define KEYBOARD_POLLING_INTERVAL    5
+#endif
+
 /** Endpoint address of the Keyboard HID reporting IN endpoint. */
 #define KEYBOARD_EPADDR              (ENDPOINT_DIR_IN | 1)
 
-/** Size in bytes of the Keyboard HID reporting IN endpoint. */
-#define KEYBOARD_EPSIZE              8
+/** Size in bytes of the Keyboard HID reporting IN endpoint, which must hold the report ID and the report. */
+#if KEYBOARD_NKRO
+#define KEYBOARD_EPSIZE              32
+#else
+#define KEYBOARD_EPSIZE              16
+#endif
 
 /* Function Prototypes: */
+void SetKeyboardPollingInterval(const uint8_t PollingIntervalMS);
+
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
                                     const uint16_t wIndex,
-                                    const void** const DescriptorAddress)
-  ATTR_WARN_UNUSED_RESULT ATTR_NON_NULL_PTR_ARG(3);
+                                    const void** const DescriptorAddress,
+                                    uint8_t* const DescriptorMemorySpace)
+  ATTR_WARN_UNUSED_RESULT ATTR_NON_NULL_PTR_ARG(3) ATTR_NON_NULL_PTR_ARG(4);
 
 #endif
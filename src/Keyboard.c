@@ -30,9 +30,6 @@
 
 #include "Keyboard.h"
 
-/** Buffer to hold the previously generated Keyboard HID report, for comparison purposes inside the HID class driver. */
-static USB_KeyboardReport_Data_t PrevKeyboardReport;
-
 /** LUFA HID Class driver interface configuration and state information. This structure is
  *  passed to all HID Class driver functions, so that multiple instances of the same class
  *  within a device can be differentiated from one another.
@@ -46,22 +43,21 @@ USB_ClassInfo_HID_Device_t Keyboard_HID_Interface =
     {
       .Address              = KEYBOARD_EPADDR,
       .Size                 = KEYBOARD_EPSIZE,
-      .Banks                = 1,
+      .Banks                = 2,
     },
-    .PrevReportINBuffer     = &PrevKeyboardReport,
-    .PrevReportINBufferSize = sizeof(PrevKeyboardReport),
+    .PrevReportINBuffer     = NULL, // Changes are queued by the converter core.
+    .PrevReportINBufferSize = sizeof(HIDReportBuffer_t),
   },
 };
 
-typedef uint8_t HidUsageID;
-
-static uint8_t EE_ClickerEnabled EEMEM = 0;
+static bool ReattachPending;
+static uint8_t ReattachTimer;   // Milliseconds left detached, or 0 when attached.
 
-static HidUsageID KeysDown[16];
-static uint8_t NKeysDown;
-static uint8_t KeyboardLayout, LayoutDelay;
-static bool ExpectReset, ExpectLayout;
-static bool ClickerEnabled;
+#ifndef REATTACH_MS
+#define REATTACH_MS 100         // Long enough for the host to notice.
+#endif
+static bool InControlRequest;
+static uint8_t TableReadOffset[TABLE_Count];
 
 #define LOW 0
 #define HIGH 1
@@ -75,407 +71,510 @@ static bool ClickerEnabled;
 #endif
 #endif
 
-// Taken from Linux kernel drivers/input/keyboard/sunkbd.c
-
-#define SUNKBD_CMD_RESET        0x1
-#define SUNKBD_CMD_BELLON       0x2
-#define SUNKBD_CMD_BELLOFF      0x3
-#define SUNKBD_CMD_CLICK        0xa
-#define SUNKBD_CMD_NOCLICK      0xb
-#define SUNKBD_CMD_SETLED       0xe
-#define SUNKBD_CMD_LAYOUT       0xf
-
-#define SUNKBD_RET_RESET        0xff
-#define SUNKBD_RET_ALLUP        0x7f
-#define SUNKBD_RET_LAYOUT       0xfe
-
-#define SUNKBD_LAYOUT_5_MASK    0x20
-#define SUNKBD_RELEASE          0x80
-#define SUNKBD_KEY              0x7f
-
-/*** Keyboard Map ***/
-
-// Matches Linux kernel driver by correlating sunkbd_keycode and hid_keyboard.
-
-static HidUsageID const KeyMap[128] PROGMEM = {
-  0,                            // 0x00
-  HID_KEYBOARD_SC_STOP,
-  HID_KEYBOARD_SC_VOLUME_DOWN,
-  HID_KEYBOARD_SC_AGAIN,
-  HID_KEYBOARD_SC_VOLUME_UP,
-  HID_KEYBOARD_SC_F1,
-  HID_KEYBOARD_SC_F2,
-  HID_KEYBOARD_SC_F10,
-  HID_KEYBOARD_SC_F3,           // 0x08
-  HID_KEYBOARD_SC_F11,
-  HID_KEYBOARD_SC_F4,
-  HID_KEYBOARD_SC_F12,
-  HID_KEYBOARD_SC_F5,
-  HID_KEYBOARD_SC_RIGHT_ALT,
-  HID_KEYBOARD_SC_F6,
-  HID_KEYBOARD_SC_F13,          // Unlabeled between Help and F1; KEY_MACRO (112) has no HID usage.
-  HID_KEYBOARD_SC_F7,           // 0x10
-  HID_KEYBOARD_SC_F8,
-  HID_KEYBOARD_SC_F9,
-  HID_KEYBOARD_SC_LEFT_ALT,
-  HID_KEYBOARD_SC_UP_ARROW,
-  HID_KEYBOARD_SC_PAUSE,
-  HID_KEYBOARD_SC_PRINT_SCREEN,
-  HID_KEYBOARD_SC_SCROLL_LOCK,
-  HID_KEYBOARD_SC_LEFT_ARROW,   // 0x18
-  HID_KEYBOARD_SC_MENU,
-  HID_KEYBOARD_SC_UNDO,
-  HID_KEYBOARD_SC_DOWN_ARROW,
-  HID_KEYBOARD_SC_RIGHT_ARROW,
-  HID_KEYBOARD_SC_ESCAPE,
-  HID_KEYBOARD_SC_1_AND_EXCLAMATION,
-  HID_KEYBOARD_SC_2_AND_AT,
-  HID_KEYBOARD_SC_3_AND_HASHMARK, // 0x20
-  HID_KEYBOARD_SC_4_AND_DOLLAR,
-  HID_KEYBOARD_SC_5_AND_PERCENTAGE,
-  HID_KEYBOARD_SC_6_AND_CARET,
-  HID_KEYBOARD_SC_7_AND_AMPERSAND,
-  HID_KEYBOARD_SC_8_AND_ASTERISK,
-  HID_KEYBOARD_SC_9_AND_OPENING_PARENTHESIS,
-  HID_KEYBOARD_SC_0_AND_CLOSING_PARENTHESIS,
-  HID_KEYBOARD_SC_MINUS_AND_UNDERSCORE, // 0x28
-  HID_KEYBOARD_SC_EQUAL_AND_PLUS,
-  HID_KEYBOARD_SC_GRAVE_ACCENT_AND_TILDE,
-  HID_KEYBOARD_SC_BACKSPACE,
-  HID_KEYBOARD_SC_INSERT,
-  HID_KEYBOARD_SC_MUTE,
-  HID_KEYBOARD_SC_KEYPAD_SLASH,
-  HID_KEYBOARD_SC_KEYPAD_ASTERISK,
-  HID_KEYBOARD_SC_POWER,        // 0x30
-  HID_KEYBOARD_SC_SELECT,
-  HID_KEYBOARD_SC_KEYPAD_DOT_AND_DELETE,
-  HID_KEYBOARD_SC_COPY,
-  HID_KEYBOARD_SC_HOME,
-  HID_KEYBOARD_SC_TAB,
-  HID_KEYBOARD_SC_Q,
-  HID_KEYBOARD_SC_W,
-  HID_KEYBOARD_SC_E,            // 0x38
-  HID_KEYBOARD_SC_R,
-  HID_KEYBOARD_SC_T,
-  HID_KEYBOARD_SC_Y,
-  HID_KEYBOARD_SC_U,
-  HID_KEYBOARD_SC_I,
-  HID_KEYBOARD_SC_O,
-  HID_KEYBOARD_SC_P,
-  HID_KEYBOARD_SC_OPENING_BRACKET_AND_OPENING_BRACE, // 0x40
-  HID_KEYBOARD_SC_CLOSING_BRACKET_AND_CLOSING_BRACE,
-  HID_KEYBOARD_SC_DELETE,
-  HID_KEYBOARD_SC_APPLICATION,
-  HID_KEYBOARD_SC_KEYPAD_7_AND_HOME,
-  HID_KEYBOARD_SC_KEYPAD_8_AND_UP_ARROW,
-  HID_KEYBOARD_SC_KEYPAD_9_AND_PAGE_UP,
-  HID_KEYBOARD_SC_KEYPAD_MINUS,
-  HID_KEYBOARD_SC_EXECUTE,      // 0x48
-  HID_KEYBOARD_SC_PASTE,
-  HID_KEYBOARD_SC_END,
-  0,
-  HID_KEYBOARD_SC_LEFT_CONTROL,
-  HID_KEYBOARD_SC_A,
-  HID_KEYBOARD_SC_S,
-  HID_KEYBOARD_SC_D,
-  HID_KEYBOARD_SC_F,            // 0x50
-  HID_KEYBOARD_SC_G,
-  HID_KEYBOARD_SC_H,
-  HID_KEYBOARD_SC_J,
-  HID_KEYBOARD_SC_K,
-  HID_KEYBOARD_SC_L,
-  HID_KEYBOARD_SC_SEMICOLON_AND_COLON,
-  HID_KEYBOARD_SC_APOSTROPHE_AND_QUOTE,
-  HID_KEYBOARD_SC_BACKSLASH_AND_PIPE, // 0x58
-  HID_KEYBOARD_SC_ENTER,
-  HID_KEYBOARD_SC_KEYPAD_ENTER,
-  HID_KEYBOARD_SC_KEYPAD_4_AND_LEFT_ARROW,
-  HID_KEYBOARD_SC_KEYPAD_5,
-  HID_KEYBOARD_SC_KEYPAD_6_AND_RIGHT_ARROW,
-  HID_KEYBOARD_SC_KEYPAD_0_AND_INSERT,
-  HID_KEYBOARD_SC_FIND,
-  HID_KEYBOARD_SC_PAGE_UP,      // 0x60
-  HID_KEYBOARD_SC_CUT,
-  HID_KEYBOARD_SC_NUM_LOCK,
-  HID_KEYBOARD_SC_LEFT_SHIFT,
-  HID_KEYBOARD_SC_Z,
-  HID_KEYBOARD_SC_X,
-  HID_KEYBOARD_SC_C,
-  HID_KEYBOARD_SC_V,
-  HID_KEYBOARD_SC_B,            // 0x68
-  HID_KEYBOARD_SC_N,
-  HID_KEYBOARD_SC_M,
-  HID_KEYBOARD_SC_COMMA_AND_LESS_THAN_SIGN,
-  HID_KEYBOARD_SC_DOT_AND_GREATER_THAN_SIGN,
-  HID_KEYBOARD_SC_SLASH_AND_QUESTION_MARK,
-  HID_KEYBOARD_SC_RIGHT_SHIFT,
-  HID_KEYBOARD_SC_F14,          // Line Feed; KEY_LINEFEED (101) has no HID usage.
-  HID_KEYBOARD_SC_KEYPAD_1_AND_END, // 0x70
-  HID_KEYBOARD_SC_KEYPAD_2_AND_DOWN_ARROW,
-  HID_KEYBOARD_SC_KEYPAD_3_AND_PAGE_DOWN,
-  0,
-  0,
-  0,
-  HID_KEYBOARD_SC_HELP,
-  HID_KEYBOARD_SC_CAPS_LOCK,
-  HID_KEYBOARD_SC_LEFT_GUI,     // 0x78
-  HID_KEYBOARD_SC_SPACE,
-  HID_KEYBOARD_SC_RIGHT_GUI,
-  HID_KEYBOARD_SC_PAGE_DOWN,
-  HID_KEYBOARD_SC_NON_US_BACKSLASH_AND_PIPE,
-  HID_KEYBOARD_SC_KEYPAD_PLUS,
-  0,
-  0
+/*** Events ***/
+
+// The interrupts set a bit here for the main loop, which runs the tasks
+// that have something to do. When no bit is set and no report is
+// waiting for the host, it sleeps in idle mode: the USART, timer and
+// USB keep running, and any of their interrupts wakes it. That is at
+// least every millisecond, from the timer, so the host's control
+// requests, which the USB task polls for, still get a prompt answer.
+
+#ifndef SUNKBD_IDLE_SLEEP
+#define SUNKBD_IDLE_SLEEP 1
+#endif
+
+enum EventFlags_t
+{
+  EVENT_FLAG_Rx     = (1 << 0), /**< Bytes from the keyboard are in the ring buffer. */
+  EVENT_FLAG_TxDone = (1 << 1), /**< The command queue has been sent. */
+  EVENT_FLAG_Tick   = (1 << 2), /**< A millisecond has gone by. */
+  EVENT_FLAG_SOF    = (1 << 3), /**< The host sent a start of frame. */
+  EVENT_FLAG_USB    = (1 << 4), /**< The USB bus or device state changed. */
+  EVENT_FLAG_Power  = (1 << 5), /**< The Power key line changed. */
 };
 
-/*** Keyboard Interface ***/
+static volatile uint8_t PendingEvents;
 
-static void SunKbd_Init(void)
+static volatile bool USBSuspended; // As the USB interrupt last saw it.
+
+/*** Serial Receive ***/
+
+// Bytes from the keyboard are queued by the USART receive interrupt,
+// so that nothing is lost while the USB task is busy with a long
+// control transfer. The interrupt only ever advances RxHead and the
+// main loop only ever advances RxTail, so no locking is needed.
+// Each byte keeps its error bits, so that the parser can tell a break
+// from noise and does not take a damaged byte for a key.
+
+#ifndef SUNKBD_RX_BUFFER_SIZE
+#define SUNKBD_RX_BUFFER_SIZE 16
+#endif
+#define SUNKBD_RX_BUFFER_MASK (SUNKBD_RX_BUFFER_SIZE - 1)
+
+#if (SUNKBD_RX_BUFFER_SIZE & SUNKBD_RX_BUFFER_MASK) != 0
+#error SUNKBD_RX_BUFFER_SIZE must be a power of two
+#endif
+
+static volatile uint8_t RxBuffer[SUNKBD_RX_BUFFER_SIZE];
+static volatile uint16_t RxTime[SUNKBD_RX_BUFFER_SIZE];
+static volatile uint8_t RxStatus[SUNKBD_RX_BUFFER_SIZE]; // FE1 and DOR1 from UCSR1A.
+static volatile uint8_t RxHead, RxTail;
+
+// Receive counters, only written by the interrupt.
+static volatile uint32_t RxBytes;
+static volatile uint16_t RxFramingErrors;
+static volatile uint16_t RxOverruns; // Lost because the USART data register was overrun.
+static volatile uint16_t RxDropped;  // Lost because the ring buffer was full.
+
+static uint16_t MaxLoopTicks;
+
+ISR(USART1_RX_vect, ISR_BLOCK)
 {
-  uint8_t ee;
+  uint8_t status, data, head, next;
+  uint16_t time;
 
-  Serial_Init(1200, false);
+  PROFILE_ENTER(PROFILE_RxISR);
 
-  NKeysDown = 0;
+  // Status must be read before data, since it describes the byte in UDR1.
+  status = UCSR1A;
+  data = UDR1;
+  time = TCNT1;
 
-  KeyboardLayout = 0xFF;
-  LayoutDelay = 100;
-  ExpectReset = ExpectLayout = false;
+  RxBytes++;
+  if (status & (1 << FE1)) {
+    RxFramingErrors++;
+  }
+  if (status & (1 << DOR1)) {
+    RxOverruns++;               // At least one byte before this one was lost.
+  }
 
-  ee = eeprom_read_byte(&EE_ClickerEnabled);
-  if (ee == 0xFF) {
-    ee = 0;
-    eeprom_write_byte(&EE_ClickerEnabled, ee);
+  head = RxHead;
+  next = (head + 1) & SUNKBD_RX_BUFFER_MASK;
+  if (next == RxTail) {
+    RxDropped++;
   }
-  ClickerEnabled = (bool)ee;
+  else {
+    RxBuffer[head] = data;
+    RxTime[head] = time;
+    RxStatus[head] = status & ((1 << FE1) | (1 << DOR1));
+    RxHead = next;
+  }
+  PendingEvents |= EVENT_FLAG_Rx;
+
+  PROFILE_EXIT(PROFILE_RxISR);
 }
 
-static void SunKbd_Task(void)
-{
-  uint8_t key;
-  int16_t in;
-  int i;
+/*** Serial Transmit ***/
 
-  in = Serial_ReceiveByte();
-  if (in < 0) return;
+// The converter core queues commands; they are written from the data
+// register empty interrupt, so that nothing waits on the line.
 
-  key = (uint8_t)in;
+ISR(USART1_UDRE_vect, ISR_BLOCK)
+{
+  int16_t next;
+
+  PROFILE_ENTER(PROFILE_UdreISR);
 
-  if (ExpectReset) {
-    ExpectReset = false;
+  next = SunKbd_NextCommandByte();
+  if (next < 0) {
+    UCSR1B &= ~(1 << UDRIE1);   // Nothing left: stop interrupting.
+    PendingEvents |= EVENT_FLAG_TxDone;
   }
-  else if (ExpectLayout) {
-    KeyboardLayout = key;
-    ExpectLayout = false;
+  else {
+    UDR1 = (uint8_t)next;
   }
-  else if (key == SUNKBD_RET_ALLUP) {
-    NKeysDown = 0;
+
+  PROFILE_EXIT(PROFILE_UdreISR);
+}
+
+void SunKbd_StartTransmit(void)
+{
+  UCSR1B |= (1 << UDRIE1);
+}
+
+/*** Settings EEPROM ***/
+
+// The converter core keeps the settings records and hands out the bytes
+// of a new one to write. Each byte is written by the EEPROM ready
+// interrupt while the main loop carries on, and only if it differs from
+// what is there.
+
+static uint8_t EE_Config[CONFIG_EEPROM_SIZE] EEMEM;
+
+uint8_t SunKbd_ReadConfig(uint16_t offset)
+{
+  return eeprom_read_byte(&EE_Config[offset]);
+}
+
+void SunKbd_StartConfigWrite(void)
+{
+  EECR |= (1 << EERIE);
+}
+
+ISR(EE_READY_vect, ISR_BLOCK)
+{
+  uint16_t offset;
+  int16_t next;
+
+  PROFILE_ENTER(PROFILE_EEReadyISR);
+
+  while ((next = SunKbd_NextConfigByte(&offset)) >= 0) {
+    EEAR = (uintptr_t)&EE_Config[offset];
+    EECR |= (1 << EERE);
+    if (EEDR != (uint8_t)next) {
+      EEDR = next;
+      EECR |= (1 << EEMPE);
+      EECR |= (1 << EEPE);      // Within four cycles of EEMPE; interrupts are off in here.
+      PROFILE_EXIT(PROFILE_EEReadyISR);
+      return;
+    }
   }
-  else if (key == SUNKBD_RET_RESET) {
-    ExpectReset = true;
+  EECR &= ~(1 << EERIE);
+
+  PROFILE_EXIT(PROFILE_EEReadyISR);
+}
+
+/*** Power Key ***/
+
+// Type 4 and 5 keyboards wire the Power key to its own line, pin 7 of
+// the DIN, which it pulls low. The first edge on PD0 turns its external
+// interrupt off and starts a debounce; once that has run out, the pin
+// is read and the interrupt turned back on. The debounce counts the
+// millisecond tick, so that has to run for it even while suspended.
+
+#ifndef POWER_DEBOUNCE_MS
+#define POWER_DEBOUNCE_MS 20
+#endif
+
+static bool PowerPressed;
+static uint8_t PowerDebounce;   // Milliseconds left, or 0 when settled.
+
+ISR(INT0_vect, ISR_BLOCK)
+{
+  EIMSK &= ~(1 << INT0);
+  PendingEvents |= EVENT_FLAG_Power;
+}
+
+static void Power_Init(void)
+{
+  DDRD &= ~(1 << PD0);
+  PORTD |= (1 << PD0);          // Pulled up.
+  EICRA = (EICRA & ~((1 << ISC01) | (1 << ISC00))) | (1 << ISC00); // Either edge.
+  EIFR = (1 << INTF0);
+  EIMSK |= (1 << INT0);
+}
+
+static void Power_MillisecondElapsed(void)
+{
+  bool pressed;
+
+  if ((PowerDebounce == 0) || (--PowerDebounce != 0)) return;
+
+  EIFR = (1 << INTF0);          // Forget the bounces.
+  pressed = !(PIND & (1 << PD0));
+  EIMSK |= (1 << INT0);
+
+  if (pressed != PowerPressed) {
+    PowerPressed = pressed;
+    SunKbd_PowerKey(pressed);
   }
-  else if (key == SUNKBD_RET_LAYOUT) {
-    ExpectLayout = true;
+}
+
+/*** Timestamps ***/
+
+// Timer 1 runs free, so that latency can be measured from when a byte
+// arrives to when its report goes to the endpoint. It wraps after about
+// a quarter second, which is longer than any latency worth measuring.
+// Its overflows are counted as well, for the spans that can be longer,
+// such as a sleep while the host is suspended. It also gives the converter core its milliseconds, which do not
+// depend on the host sending start of frame packets: compare A is moved
+// on a millisecond at a time, to wake the main loop.
+
+#define TIMER_TICKS_PER_MS (F_CPU / 64 / 1000)
+
+static uint16_t ClockLast;
+static volatile uint16_t TimerWraps;
+
+static void Timer_Init(void)
+{
+  TCCR1A = 0;
+  TCCR1B = (1 << CS11) | (1 << CS10); // F_CPU / 64
+  OCR1A = TCNT1 + TIMER_TICKS_PER_MS;
+  TIMSK1 |= (1 << OCIE1A) | (1 << TOIE1);
+}
+
+ISR(TIMER1_COMPA_vect, ISR_BLOCK)
+{
+  PROFILE_ENTER(PROFILE_TimerISR);
+
+  OCR1A += TIMER_TICKS_PER_MS;
+  PendingEvents |= EVENT_FLAG_Tick;
+
+  PROFILE_EXIT(PROFILE_TimerISR);
+}
+
+ISR(TIMER1_OVF_vect, ISR_BLOCK)
+{
+  TimerWraps++;
+}
+
+static uint16_t Timer_Now(void)
+{
+  uint16_t now;
+
+  // The interrupts also read the timer, through the same temporary register.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    now = TCNT1;
   }
-  else if (key & SUNKBD_RELEASE) {
-    key &= SUNKBD_KEY;
-    for (i = 0; i < NKeysDown; i++) {
-      if (KeysDown[i] == key) {
-        NKeysDown--;
-        while (i < NKeysDown) {
-          KeysDown[i] = KeysDown[i+1];
-          i++;
-        }
-        break;
-      }
+  return now;
+}
+
+/** Timer 1 with its overflows, for spans longer than it wraps. */
+static uint32_t Timer_Now32(void)
+{
+  uint16_t low, high;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    low = TCNT1;
+    high = TimerWraps;
+    if ((TIFR1 & (1 << TOV1)) && (low < 0x8000)) {
+      high++;                   // Wrapped, but the interrupt has not run yet.
     }
   }
-  else {
-    if (NKeysDown < sizeof(KeysDown)) {
-      KeysDown[NKeysDown++] = key;
-    }
+  return ((uint32_t)high << 16) | low;
+}
+
+/** Detach from the bus so that the host reads the configuration again, and attach once
+ *  REATTACH_MS have gone by. The main loop keeps running meanwhile.
+ */
+static void Reattach_Start(void)
+{
+  USB_Detach();
+  SetKeyboardPollingInterval(Config.PollingInterval);
+  ReattachTimer = REATTACH_MS;
+}
+
+static void Reattach_MillisecondElapsed(void)
+{
+  if ((ReattachTimer == 0) || (--ReattachTimer != 0)) return;
+  USB_Attach();
+}
+
+static void Clock_Task(void)
+{
+  uint16_t now;
+
+  now = Timer_Now();
+  while ((uint16_t)(now - ClockLast) >= TIMER_TICKS_PER_MS) {
+    ClockLast += TIMER_TICKS_PER_MS;
+    SunKbd_MillisecondElapsed();
+    Power_MillisecondElapsed();
+    Reattach_MillisecondElapsed();
   }
+}
 
-  if (NKeysDown > 0) {
-    LEDs_TurnOnLEDs(KEYDOWN_LED);
+/** Run the millisecond tick or stop it. The converter core does not count the time it was
+ *  stopped.
+ */
+static void Timer_Tick(bool enable)
+{
+  if (enable == ((TIMSK1 & (1 << OCIE1A)) != 0)) return;
+
+  if (enable) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      ClockLast = TCNT1;
+      OCR1A = ClockLast + TIMER_TICKS_PER_MS;
+    }
+    TIMSK1 |= (1 << OCIE1A);
   }
   else {
-    LEDs_TurnOffLEDs(KEYDOWN_LED);
+    TIMSK1 &= ~(1 << OCIE1A);
   }
 }
 
-static void UpdateSunLEDs(uint8_t LEDMask)
+/*** Duty Cycle ***/
+
+// The main loop adds up the ticks it is awake against the ticks that go
+// by, and works out the share awake, in thousandths, once a window of
+// about a second is full. A pass of the loop is well under a wrap of the
+// timer, but a sleep need not be, so the ticks that go by are taken with
+// the overflows.
+
+#define DUTY_WINDOW_TICKS (1UL << 18)
+
+static uint32_t DutyLast;
+static uint32_t DutyActive, DutyTotal;
+static uint16_t DutyCycle, MaxDutyCycle;
+
+static void Duty_Wake(void)
 {
-  Serial_SendByte(SUNKBD_CMD_SETLED);
-  Serial_SendByte(LEDMask);
+  uint32_t now = Timer_Now32();
+
+  DutyTotal += now - DutyLast;
+  DutyLast = now;
 }
 
-static void SetClickerEnabled(bool enabled)
+static void Duty_Sleep(uint16_t wake)
 {
-  Serial_SendByte(enabled ? SUNKBD_CMD_CLICK : SUNKBD_CMD_NOCLICK);
-  ClickerEnabled = enabled;
-  eeprom_write_byte(&EE_ClickerEnabled, (uint8_t)enabled);
+  DutyActive += (uint16_t)(Timer_Now() - wake);
+  if (DutyTotal < DUTY_WINDOW_TICKS) return;
+
+  DutyCycle = (DutyActive * 1000) / DutyTotal;
+  if (DutyCycle > MaxDutyCycle) {
+    MaxDutyCycle = DutyCycle;
+  }
+  DutyActive = DutyTotal = 0;
 }
 
-#ifndef DEBUG_UNMAPPED
-#define DEBUG_UNMAPPED 0
-#endif
+/*** Suspend ***/
 
-#if DEBUG_UNMAPPED
-
-static HidUsageID encodeHighForDebug(uint8_t code) {
-  switch (code) {
-  case 0x00:
-    return HID_KEYBOARD_SC_G;
-  case 0x10:
-    return HID_KEYBOARD_SC_H;
-  case 0x20:
-    return HID_KEYBOARD_SC_I;
-  case 0x30:
-    return HID_KEYBOARD_SC_J;
-  case 0x40:
-    return HID_KEYBOARD_SC_K;
-  case 0x50:
-    return HID_KEYBOARD_SC_L;
-  case 0x60:
-    return HID_KEYBOARD_SC_M;
-  case 0x70:
-    return HID_KEYBOARD_SC_N;
-  case 0x80:
-    return HID_KEYBOARD_SC_O;
-  case 0x90:
-    return HID_KEYBOARD_SC_P;
-  case 0xA0:
-    return HID_KEYBOARD_SC_Q;
-  case 0xB0:
-    return HID_KEYBOARD_SC_R;
-  case 0xC0:
-    return HID_KEYBOARD_SC_S;
-  case 0xD0:
-    return HID_KEYBOARD_SC_T;
-  case 0xE0:
-    return HID_KEYBOARD_SC_U;
-  case 0xF0:
-    return HID_KEYBOARD_SC_V;
-  default:
-    return 0;
+// While the host is suspended, the keyboard LEDs and click are turned
+// off and the millisecond tick is stopped, so that the main loop only
+// wakes for the keyboard, and for the timer overflow four times a
+// second. LUFA has already stopped the USB clock. The
+// USART has to keep running to catch the key that wakes the host, so
+// the sleep is still idle mode. The first key pressed, or the Power
+// key, asks the host for a remote wakeup, if it allowed one; the key
+// itself is queued for when the host has resumed.
+
+static bool Suspended;
+static bool WakeupSent;
+
+static void Suspend_Task(void)
+{
+  bool suspended;
+
+  suspended = USBSuspended;
+  if (suspended != Suspended) {
+    Suspended = suspended;
+    WakeupSent = false;
+    SunKbd_Suspend(suspended);
   }
+
+  if (Suspended && !WakeupSent && ((NKeysDown > 0) || PowerPressed) &&
+      USB_Device_RemoteWakeupEnabled) {
+    USB_Device_SendRemoteWakeup();
+    WakeupSent = true;
+  }
+
+  Timer_Tick(!Suspended || (PowerDebounce != 0) || (ReattachTimer != 0));
 }
 
-static HidUsageID encodeLowForDebug(uint8_t code) {
-  switch (code) {
-  case 0x00:
-    return HID_KEYBOARD_SC_0_AND_CLOSING_PARENTHESIS;
-  case 0x10:
-    return HID_KEYBOARD_SC_1_AND_EXCLAMATION;
-  case 0x02:
-    return HID_KEYBOARD_SC_2_AND_AT;
-  case 0x03:
-    return HID_KEYBOARD_SC_3_AND_HASHMARK;
-  case 0x04:
-    return HID_KEYBOARD_SC_4_AND_DOLLAR;
-  case 0x05:
-    return HID_KEYBOARD_SC_5_AND_PERCENTAGE;
-  case 0x06:
-    return HID_KEYBOARD_SC_6_AND_CARET;
-  case 0x07:
-    return HID_KEYBOARD_SC_7_AND_AMPERSAND;
-  case 0x08:
-    return HID_KEYBOARD_SC_8_AND_ASTERISK;
-  case 0x09:
-    return HID_KEYBOARD_SC_9_AND_OPENING_PARENTHESIS;
-  case 0x0A:
-    return HID_KEYBOARD_SC_A;
-  case 0x0B:
-    return HID_KEYBOARD_SC_B;
-  case 0x0C:
-    return HID_KEYBOARD_SC_C;
-  case 0x0D:
-    return HID_KEYBOARD_SC_D;
-  case 0x0E:
-    return HID_KEYBOARD_SC_E;
-  case 0x0F:
-    return HID_KEYBOARD_SC_F;
-  default:
-    return 0;
+/*** Keyboard Interface ***/
+
+static void ClearRxCounters(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    RxBytes = 0;
+    RxFramingErrors = RxOverruns = RxDropped = 0;
   }
+  MaxLoopTicks = 0;
+  MaxDutyCycle = 0;
 }
 
-#endif
+static void SunKbd_Init(void)
+{
+  Serial_Init(1200, false);
 
-static void FillKeyReport(USB_KeyboardReport_Data_t* KeyboardReport)
-{
-  HidUsageID usage;
-  int i, n;
-  int shifts;
-
-  shifts = 0;
-  n = 0;
-  for (i = 0; i < NKeysDown; i++) {
-    usage = pgm_read_byte(&KeyMap[KeysDown[i]]);
-    if ((KeyboardLayout & SUNKBD_LAYOUT_5_MASK) == 0) {
-      // Codes that are reused on Type 5.
-      switch (usage) {
-      case HID_KEYBOARD_SC_MUTE:
-        usage = HID_KEYBOARD_SC_KEYPAD_EQUAL_SIGN;
-        break;
-      }
+  Timer_Init();
+  Power_Init();
+
+  RxHead = RxTail = 0;
+  ClearRxCounters();
+  UCSR1B |= (1 << RXCIE1);
+
+  SunKbd_InitState();
+
+  Config_Load();
+  SunKbd_SetClick(Config.Click); // Sent once the keyboard is started.
+  if ((Config.PollingInterval == 0) || (Config.PollingInterval == 0xFF)) {
+    Config.PollingInterval = KEYBOARD_POLLING_INTERVAL;
+  }
+  SetKeyboardPollingInterval(Config.PollingInterval);
+
+  ClockLast = Timer_Now();
+  DutyLast = Timer_Now32();
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  SunKbd_Start();
+}
+
+static void SunKbd_Task(void)
+{
+  uint8_t head, tail, status;
+
+  // Drain everything that has arrived so far as one batch; anything
+  // that comes in meanwhile waits for the next pass.
+  head = RxHead;
+  tail = RxTail;
+  if (tail == head) return;
+
+  PROFILE_ENTER(PROFILE_SunKbdTask);
+
+  do {
+    status = RxStatus[tail];
+    if (status == 0) {
+      SunKbd_ProcessByte(RxBuffer[tail], RxTime[tail]);
     }
-    switch (usage) {
-    case 0:
-#if DEBUG_UNMAPPED
-      if (n+3 <= sizeof(KeyboardReport->KeyCode)) {
-        KeyboardReport->KeyCode[n++] = HID_KEYBOARD_SC_X;
-        KeyboardReport->KeyCode[n++] = encodeHighForDebug(KeysDown[i] & 0xF0);
-        KeyboardReport->KeyCode[n++] = encodeLowForDebug(KeysDown[i] & 0x0F);
-      }
-#endif
-      break;
-    case HID_KEYBOARD_SC_LEFT_CONTROL:
-      shifts |= HID_KEYBOARD_MODIFIER_LEFTCTRL;
-      break;
-    case HID_KEYBOARD_SC_LEFT_SHIFT:
-      shifts |= HID_KEYBOARD_MODIFIER_LEFTSHIFT;
-      break;
-    case HID_KEYBOARD_SC_LEFT_ALT:
-      shifts |= HID_KEYBOARD_MODIFIER_LEFTALT;
-      break;
-    case HID_KEYBOARD_SC_LEFT_GUI:
-      shifts |= HID_KEYBOARD_MODIFIER_LEFTGUI;
-      break;
-    case HID_KEYBOARD_SC_RIGHT_CONTROL:
-      shifts |= HID_KEYBOARD_MODIFIER_RIGHTCTRL;
-      break;
-    case HID_KEYBOARD_SC_RIGHT_SHIFT:
-      shifts |= HID_KEYBOARD_MODIFIER_RIGHTSHIFT;
-      break;
-    case HID_KEYBOARD_SC_RIGHT_ALT:
-      shifts |= HID_KEYBOARD_MODIFIER_RIGHTALT;
-      break;
-    case HID_KEYBOARD_SC_RIGHT_GUI:
-      shifts |= HID_KEYBOARD_MODIFIER_RIGHTGUI;
-      break;
-    default:
-      if (n < sizeof(KeyboardReport->KeyCode)) {
-        KeyboardReport->KeyCode[n] = usage;
-      }
-      n++;
-      break;
+    else {
+      SunKbd_LineError(RxBuffer[tail],
+                       ((status & (1 << FE1)) ? SUNKBD_LINE_FRAMING : 0) |
+                       ((status & (1 << DOR1)) ? SUNKBD_LINE_OVERRUN : 0));
     }
+    tail = (tail + 1) & SUNKBD_RX_BUFFER_MASK;
+  } while (tail != head);
+  RxTail = tail;
+
+  if (NKeysDown > 0) {
+    LEDs_TurnOnLEDs(KEYDOWN_LED);
   }
-    
-  KeyboardReport->Modifier = shifts;
-  
-  if (n > sizeof(KeyboardReport->KeyCode)) {
-    for (i = 0; i < sizeof(KeyboardReport->KeyCode); i++) {
-      KeyboardReport->KeyCode[i] = HID_KEYBOARD_SC_ERROR_ROLLOVER;
-    }
+  else {
+    LEDs_TurnOffLEDs(KEYDOWN_LED);
   }
 
+  PROFILE_EXIT(PROFILE_SunKbdTask);
+}
+
+static void SetClickerEnabled(bool enabled)
+{
+  SunKbd_SetClick(enabled);
+  if (enabled == Config.Click) return;
+  Config.Click = enabled;
+  Config_Changed();
+}
+
+static void SetPollingInterval(uint8_t interval)
+{
+  if ((interval == 0) || (interval == 0xFF) || (interval == Config.PollingInterval)) return;
+  Config.PollingInterval = interval;
+  Config_Changed();
+  ReattachPending = true;       // Host has to read the configuration again.
+}
+
+static void SetTapTime(uint8_t ms)
+{
+  if ((ms == 0xFF) || (ms == Config.TapTime)) return;
+  Config.TapTime = ms;          // 0 for the default.
+  Config_Changed();
 }
 
 /*** Device Application ***/
 
+/** Sleep until an interrupt, unless there is something to do already. */
+static void Idle_Sleep(void)
+{
+#if SUNKBD_IDLE_SLEEP
+  cli();
+  if ((PendingEvents == 0) && (Suspended || ((Report_Pending() == 0) && (Control_Pending() == 0)))) {
+    sleep_enable();
+    sei();                      // Takes effect after the next instruction, so no wakeup is missed.
+    sleep_cpu();
+    sleep_disable();
+  }
+  sei();
+#endif
+}
+
 /** Main program entry point. This routine contains the overall program flow, including initial
  *  setup of all components and the main program loop.
  */
@@ -487,9 +586,51 @@ int main(void)
   GlobalInterruptEnable();
 
   while (true) {
-    SunKbd_Task();
+    uint16_t LoopStart, LoopTicks;
+    uint8_t Events;
+
+    PROFILE_ENTER(PROFILE_MainLoop);
+    LoopStart = Timer_Now();
+    Duty_Wake();
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      Events = PendingEvents;
+      PendingEvents = 0;
+    }
+
+    if (Events & (EVENT_FLAG_Tick | EVENT_FLAG_SOF)) {
+      Clock_Task();
+    }
+    if (Events & EVENT_FLAG_Rx) {
+      SunKbd_Task();
+    }
+    if (Events & EVENT_FLAG_Power) {
+      PowerDebounce = POWER_DEBOUNCE_MS;
+    }
+    Suspend_Task();
+
+    PROFILE_ENTER(PROFILE_HIDTask);
     HID_Device_USBTask(&Keyboard_HID_Interface);
+    PROFILE_EXIT(PROFILE_HIDTask);
+
+    PROFILE_ENTER(PROFILE_USBTask);
     USB_USBTask();
+    PROFILE_EXIT(PROFILE_USBTask);
+
+    LoopTicks = Timer_Now() - LoopStart;
+    if (LoopTicks > MaxLoopTicks) {
+      MaxLoopTicks = LoopTicks;
+    }
+
+    if (ReattachPending) {
+      ReattachPending = false;
+      Reattach_Start();
+    }
+
+    PROFILE_EXIT(PROFILE_MainLoop);
+
+    Duty_Sleep(LoopStart);
+    Idle_Sleep();
   }
 }
 
@@ -524,15 +665,39 @@ void SetupHardware(void)
 /** Event handler for the library USB Connection event. */
 void EVENT_USB_Device_Connect(void)
 {
+  PendingEvents |= EVENT_FLAG_USB;
   LEDs_SetAllLEDs(LEDMASK_USB_ENUMERATING);
 }
 
 /** Event handler for the library USB Disconnection event. */
 void EVENT_USB_Device_Disconnect(void)
 {
+  USBSuspended = false;
+  PendingEvents |= EVENT_FLAG_USB;
   LEDs_SetAllLEDs(LEDMASK_USB_NOTREADY);
 }
 
+/** Event handler for the library USB Reset event. */
+void EVENT_USB_Device_Reset(void)
+{
+  USBSuspended = false;
+  PendingEvents |= EVENT_FLAG_USB;
+}
+
+/** Event handler for the library USB Suspend event. */
+void EVENT_USB_Device_Suspend(void)
+{
+  USBSuspended = true;
+  PendingEvents |= EVENT_FLAG_USB;
+}
+
+/** Event handler for the library USB Wake Up event. */
+void EVENT_USB_Device_WakeUp(void)
+{
+  USBSuspended = false;
+  PendingEvents |= EVENT_FLAG_USB;
+}
+
 /** Event handler for the library USB Configuration Changed event. */
 void EVENT_USB_Device_ConfigurationChanged(void)
 {
@@ -548,24 +713,20 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 /** Event handler for the library USB Control Request reception event. */
 void EVENT_USB_Device_ControlRequest(void)
 {
+  InControlRequest = true;
   HID_Device_ProcessControlRequest(&Keyboard_HID_Interface);
+  InControlRequest = false;
 }
 
 /** Event handler for the USB device Start Of Frame event. */
 void EVENT_USB_Device_StartOfFrame(void)
 {
+  PROFILE_ENTER(PROFILE_StartOfFrame);
+
+  PendingEvents |= EVENT_FLAG_SOF;
   HID_Device_MillisecondElapsed(&Keyboard_HID_Interface);
 
-  if ((KeyboardLayout == 0xFF) &&
-      (LayoutDelay > 0)) {
-    LayoutDelay--;
-    if (LayoutDelay == 0) {
-      Serial_SendByte(SUNKBD_CMD_LAYOUT); // Request layout.
-      if (ClickerEnabled) {
-        Serial_SendByte(SUNKBD_CMD_CLICK);
-      }
-    }
-  }
+  PROFILE_EXIT(PROFILE_StartOfFrame);
 }
 
 /** HID class driver callback function for the creation of HID reports to the host.
@@ -584,20 +745,97 @@ bool CALLBACK_HID_Device_CreateHIDReport(USB_ClassInfo_HID_Device_t* const HIDIn
                                          void* ReportData,
                                          uint16_t* const ReportSize)
 {
+  bool ForceSend = false;
+  uint8_t Control = 0;
+
   switch (ReportType) {
   case HID_REPORT_ITEM_In:
-    {
-      USB_KeyboardReport_Data_t* KeyboardReport = (USB_KeyboardReport_Data_t*)ReportData;
-      FillKeyReport(KeyboardReport);
-      *ReportSize = sizeof(USB_KeyboardReport_Data_t);
+    PROFILE_ENTER(PROFILE_CreateReport);
+    // Queued reports are in the old format after a protocol change; make sure the current state goes out.
+    if (Report_SetProtocol(HIDInterfaceInfo->State.UsingReportProtocol)) {
+      ForceSend = true;
     }
-    return false;
+    // Control report changes go out when no keyboard change is waiting.
+    if (InControlRequest) {
+      Control = (*ReportID == REPORT_ID_Consumer) ? CONTROL_REPORT_Consumer :
+                (*ReportID == REPORT_ID_SystemControl) ? CONTROL_REPORT_System : 0;
+      if (Control != 0) {
+        Control_Create(Control, ReportData, ReportSize, false);
+      }
+    }
+    else if (Report_Pending() == 0) {
+      Control = Control_Create(0, ReportData, ReportSize, true);
+      if (Control != 0) {
+        ForceSend = true;
+      }
+    }
+    if (Control != 0) {
+      *ReportID = (Control == CONTROL_REPORT_Consumer) ? REPORT_ID_Consumer : REPORT_ID_SystemControl;
+      PROFILE_EXIT(PROFILE_CreateReport);
+      return ForceSend;
+    }
+    // A GET_REPORT request just gets the current state and does not use up the queue.
+    if (Report_Create(ReportData, ReportSize, !InControlRequest)) {
+      ForceSend = true;
+      Report_Sent(Timer_Now()); // The driver writes it to the endpoint right after this.
+    }
+    *ReportID = HIDInterfaceInfo->State.UsingReportProtocol ? REPORT_ID_Keyboard : 0;
+    PROFILE_EXIT(PROFILE_CreateReport);
+    return ForceSend;
   case HID_REPORT_ITEM_Feature:
+    if (*ReportID == REPORT_ID_Latency) {
+      USB_LatencyReport_Data_t* LatencyReport = (USB_LatencyReport_Data_t*)ReportData;
+      LatencyReport->TickMicroseconds = LATENCY_TICK_US;
+      LatencyReport->Latency = Latency;
+      *ReportSize = sizeof(USB_LatencyReport_Data_t);
+      return true;
+    }
+    if (*ReportID == REPORT_ID_Stats) {
+      USB_StatsReport_Data_t* StatsReport = (USB_StatsReport_Data_t*)ReportData;
+      StatsReport->TickMicroseconds = LATENCY_TICK_US;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        StatsReport->BytesReceived = RxBytes;
+        StatsReport->FramingErrors = RxFramingErrors;
+        StatsReport->Overruns = RxOverruns;
+        StatsReport->RxDropped = RxDropped;
+        StatsReport->TxQueued = TxQueued;
+        StatsReport->TxCoalesced = TxCoalesced;
+      }
+      StatsReport->RepeatedPresses = RepeatedPresses;
+      StatsReport->PressesDropped = PressesDropped;
+      StatsReport->UnmatchedReleases = UnmatchedReleases;
+      StatsReport->RolloverEvents = RolloverEvents;
+      StatsReport->ReportsSent = ReportsSent;
+      StatsReport->ReportsSuppressed = ReportsSuppressed;
+      StatsReport->QueueOverflows = ReportQueueOverflows;
+      StatsReport->MaxLoopTicks = MaxLoopTicks;
+      StatsReport->KeyboardLosses = KeyboardLosses;
+      StatsReport->BytesQuarantined = BytesQuarantined;
+      StatsReport->DutyCycle = DutyCycle;
+      StatsReport->MaxDutyCycle = MaxDutyCycle;
+      *ReportSize = sizeof(USB_StatsReport_Data_t);
+      return true;
+    }
+    if ((*ReportID == REPORT_ID_Remap) || (*ReportID == REPORT_ID_Macros)) {
+      USB_TableReport_Data_t* TableReport = (USB_TableReport_Data_t*)ReportData;
+      uint8_t Table = (*ReportID == REPORT_ID_Remap) ? TABLE_Remap : TABLE_Macros;
+      TableReport->Command = TABLE_COMMAND_Read;
+      TableReport->Offset = TableReadOffset[Table];
+      Table_Read(Table, TableReport->Offset, TableReport->Piece);
+      *ReportSize = sizeof(USB_TableReport_Data_t);
+      return true;
+    }
+    if (*ReportID != REPORT_ID_Settings) {
+      *ReportSize = 0;
+      return false;
+    }
     {
       uint8_t* FeatureReport = (uint8_t*)ReportData;
       FeatureReport[0] = (uint8_t)KeyboardLayout;
-      FeatureReport[1] = (uint8_t)ClickerEnabled;
-      *ReportSize = 2;
+      FeatureReport[1] = Config.Click;
+      FeatureReport[2] = Config.PollingInterval;
+      FeatureReport[3] = Config.TapTime;
+      *ReportSize = 4;
     }
     return true;
   default:
@@ -620,8 +858,12 @@ void CALLBACK_HID_Device_ProcessHIDReport(USB_ClassInfo_HID_Device_t* const HIDI
                                           const void* ReportData,
                                           const uint16_t ReportSize)
 {
+  PROFILE_ENTER(PROFILE_ProcessReport);
+
   switch (ReportType) {
   case HID_REPORT_ITEM_Out:
+    // No report ID in boot protocol.
+    if ((ReportID != 0) && (ReportID != REPORT_ID_Keyboard)) break;
     if (ReportSize > 0) {
       uint8_t* LEDReport = (uint8_t*)ReportData;
       uint8_t  LEDMask   = 0;
@@ -635,14 +877,52 @@ void CALLBACK_HID_Device_ProcessHIDReport(USB_ClassInfo_HID_Device_t* const HIDI
       if (*LEDReport & HID_KEYBOARD_LED_CAPSLOCK)
         LEDMask |= (1 << 3);
 
-      UpdateSunLEDs(LEDMask);
+      SunKbd_SetLEDs(LEDMask);
     }
     break;
   case HID_REPORT_ITEM_Feature:
+    if (ReportID == REPORT_ID_Latency) {
+      Latency_Clear();
+      break;
+    }
+    if (ReportID == REPORT_ID_Stats) {
+      Stats_Clear();
+      ClearRxCounters();
+      break;
+    }
+    if (((ReportID == REPORT_ID_Remap) || (ReportID == REPORT_ID_Macros)) &&
+        (ReportSize >= sizeof(USB_TableReport_Data_t))) {
+      const USB_TableReport_Data_t* TableReport = (const USB_TableReport_Data_t*)ReportData;
+      uint8_t Table = (ReportID == REPORT_ID_Remap) ? TABLE_Remap : TABLE_Macros;
+      switch (TableReport->Command) {
+      case TABLE_COMMAND_Begin:
+        Table_Begin(Table);
+        break;
+      case TABLE_COMMAND_Load:
+        Table_Load(Table, TableReport->Offset, TableReport->Piece);
+        break;
+      case TABLE_COMMAND_Swap:
+        Table_Swap(Table);      // The host reads the table back to see if it took.
+        break;
+      case TABLE_COMMAND_Read:
+        TableReadOffset[Table] = TableReport->Offset;
+        break;
+      }
+      break;
+    }
+    if (ReportID != REPORT_ID_Settings) break;
     if (ReportSize > 1) {
       uint8_t* FeatureReport = (uint8_t*)ReportData;
       SetClickerEnabled(FeatureReport[1]);
+      if (ReportSize > 2) {
+        SetPollingInterval(FeatureReport[2]);
+      }
+      if (ReportSize > 3) {
+        SetTapTime(FeatureReport[3]);
+      }
     }
     break;
   }
+
+  PROFILE_EXIT(PROFILE_ProcessReport);
 }
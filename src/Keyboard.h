@@ -36,16 +36,33 @@
 #include <avr/wdt.h>
 #include <avr/power.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <stdbool.h>
 #include <string.h>
 
 #include "Descriptors.h"
+#include "SunKbd.h"
+#include "Profile.h"
 
 #include <LUFA/Drivers/Board/LEDs.h>
 #include <LUFA/Drivers/USB/USB.h>
 #include <LUFA/Drivers/Peripheral/Serial.h>
 #include <LUFA/Platform/Platform.h>
 
+/** Microseconds per tick of the timestamp timer, Timer 1 running at F_CPU / 64. */
+#define LATENCY_TICK_US         (64000000UL / F_CPU)
+
+/** Largest report that the HID class driver has to buffer. */
+typedef union
+{
+  KeyboardReportBuffer_t         Keyboard;
+  USB_SystemControlReport_Data_t SystemControl;
+  USB_ConsumerReport_Data_t      Consumer;
+  USB_LatencyReport_Data_t       Latency;
+  USB_StatsReport_Data_t         Stats;
+  USB_TableReport_Data_t         Table;
+} HIDReportBuffer_t;
+
 /** LED mask for the library onboard LED driver, to indicate that the USB interface is not ready. */
 #define LEDMASK_USB_NOTREADY    (LEDS_LED1 | LEDS_LED2)
 
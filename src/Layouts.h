@@ -0,0 +1,1360 @@
+/* Generated by genlayouts.py from layouts.txt; do not edit. */
+
+/** Consumer page usages, one bit each in the Consumer report, in bit order. */
+#define CONSUMER_CONTROL_COUNT 10
+#define CONSUMER_CONTROL_USAGES \
+  HID_RI_USAGE(16, 0x0226), /* AC_STOP */ \
+  HID_RI_USAGE(16, 0x0279), /* AC_REDO */ \
+  HID_RI_USAGE(16, 0x021A), /* AC_UNDO */ \
+  HID_RI_USAGE(16, 0x021B), /* AC_COPY */ \
+  HID_RI_USAGE(16, 0x021D), /* AC_PASTE */ \
+  HID_RI_USAGE(16, 0x021C), /* AC_CUT */ \
+  HID_RI_USAGE(16, 0x021F), /* AC_FIND */ \
+  HID_RI_USAGE(16, 0x00E9), /* VOLUME_INCREMENT */ \
+  HID_RI_USAGE(16, 0x00EA), /* VOLUME_DECREMENT */ \
+  HID_RI_USAGE(16, 0x00E2), /* MUTE */
+
+#ifndef LAYOUTS_CONTROLS_ONLY
+
+/** Keymap for Type 4 keyboards, from Sun scancode to HID usage. */
+static HidUsageID const KeyMap_Type4[128] PROGMEM = {
+  0,                             // 0x00
+  KEYMAP_CONSUMER_FIRST + 0,     // AC_STOP
+  KEYMAP_CONSUMER_FIRST + 8,     // VOLUME_DECREMENT
+  KEYMAP_CONSUMER_FIRST + 1,     // AC_REDO
+  KEYMAP_CONSUMER_FIRST + 7,     // VOLUME_INCREMENT
+  HID_KEYBOARD_SC_F1,
+  HID_KEYBOARD_SC_F2,
+  HID_KEYBOARD_SC_F10,
+  HID_KEYBOARD_SC_F3,            // 0x08
+  HID_KEYBOARD_SC_F11,
+  HID_KEYBOARD_SC_F4,
+  HID_KEYBOARD_SC_F12,
+  HID_KEYBOARD_SC_F5,
+  HID_KEYBOARD_SC_RIGHT_ALT,
+  HID_KEYBOARD_SC_F6,
+  HID_KEYBOARD_SC_F13,           // Unlabeled between Help and F1; KEY_MACRO (112) has no HID usage.
+  HID_KEYBOARD_SC_F7,            // 0x10
+  HID_KEYBOARD_SC_F8,
+  HID_KEYBOARD_SC_F9,
+  HID_KEYBOARD_SC_LEFT_ALT,
+  HID_KEYBOARD_SC_UP_ARROW,
+  HID_KEYBOARD_SC_PAUSE,
+  HID_KEYBOARD_SC_PRINT_SCREEN,
+  HID_KEYBOARD_SC_SCROLL_LOCK,
+  HID_KEYBOARD_SC_LEFT_ARROW,    // 0x18
+  HID_KEYBOARD_SC_MENU,
+  KEYMAP_CONSUMER_FIRST + 2,     // AC_UNDO
+  HID_KEYBOARD_SC_DOWN_ARROW,
+  HID_KEYBOARD_SC_RIGHT_ARROW,
+  HID_KEYBOARD_SC_ESCAPE,
+  HID_KEYBOARD_SC_1_AND_EXCLAMATION,
+  HID_KEYBOARD_SC_2_AND_AT,
+  HID_KEYBOARD_SC_3_AND_HASHMARK, // 0x20
+  HID_KEYBOARD_SC_4_AND_DOLLAR,
+  HID_KEYBOARD_SC_5_AND_PERCENTAGE,
+  HID_KEYBOARD_SC_6_AND_CARET,
+  HID_KEYBOARD_SC_7_AND_AMPERSAND,
+  HID_KEYBOARD_SC_8_AND_ASTERISK,
+  HID_KEYBOARD_SC_9_AND_OPENING_PARENTHESIS,
+  HID_KEYBOARD_SC_0_AND_CLOSING_PARENTHESIS,
+  HID_KEYBOARD_SC_MINUS_AND_UNDERSCORE, // 0x28
+  HID_KEYBOARD_SC_EQUAL_AND_PLUS,
+  HID_KEYBOARD_SC_GRAVE_ACCENT_AND_TILDE,
+  HID_KEYBOARD_SC_BACKSPACE,
+  HID_KEYBOARD_SC_INSERT,
+  HID_KEYBOARD_SC_KEYPAD_EQUAL_SIGN, // Mute on Type 5.
+  HID_KEYBOARD_SC_KEYPAD_SLASH,
+  HID_KEYBOARD_SC_KEYPAD_ASTERISK,
+  KEYMAP_SYSTEM_FIRST + 0,       // POWER_DOWN
+  HID_KEYBOARD_SC_SELECT,
+  HID_KEYBOARD_SC_KEYPAD_DOT_AND_DELETE,
+  KEYMAP_CONSUMER_FIRST + 3,     // AC_COPY
+  HID_KEYBOARD_SC_HOME,
+  HID_KEYBOARD_SC_TAB,
+  HID_KEYBOARD_SC_Q,
+  HID_KEYBOARD_SC_W,
+  HID_KEYBOARD_SC_E,             // 0x38
+  HID_KEYBOARD_SC_R,
+  HID_KEYBOARD_SC_T,
+  HID_KEYBOARD_SC_Y,
+  HID_KEYBOARD_SC_U,
+  HID_KEYBOARD_SC_I,
+  HID_KEYBOARD_SC_O,
+  HID_KEYBOARD_SC_P,
+  HID_KEYBOARD_SC_OPENING_BRACKET_AND_OPENING_BRACE, // 0x40
+  HID_KEYBOARD_SC_CLOSING_BRACKET_AND_CLOSING_BRACE,
+  HID_KEYBOARD_SC_DELETE,
+  HID_KEYBOARD_SC_APPLICATION,
+  HID_KEYBOARD_SC_KEYPAD_7_AND_HOME,
+  HID_KEYBOARD_SC_KEYPAD_8_AND_UP_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_9_AND_PAGE_UP,
+  HID_KEYBOARD_SC_KEYPAD_MINUS,
+  HID_KEYBOARD_SC_EXECUTE,       // 0x48
+  KEYMAP_CONSUMER_FIRST + 4,     // AC_PASTE
+  HID_KEYBOARD_SC_END,
+  0,
+  HID_KEYBOARD_SC_LEFT_CONTROL,
+  HID_KEYBOARD_SC_A,
+  HID_KEYBOARD_SC_S,
+  HID_KEYBOARD_SC_D,
+  HID_KEYBOARD_SC_F,             // 0x50
+  HID_KEYBOARD_SC_G,
+  HID_KEYBOARD_SC_H,
+  HID_KEYBOARD_SC_J,
+  HID_KEYBOARD_SC_K,
+  HID_KEYBOARD_SC_L,
+  HID_KEYBOARD_SC_SEMICOLON_AND_COLON,
+  HID_KEYBOARD_SC_APOSTROPHE_AND_QUOTE,
+  HID_KEYBOARD_SC_BACKSLASH_AND_PIPE, // 0x58
+  HID_KEYBOARD_SC_ENTER,
+  HID_KEYBOARD_SC_KEYPAD_ENTER,
+  HID_KEYBOARD_SC_KEYPAD_4_AND_LEFT_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_5,
+  HID_KEYBOARD_SC_KEYPAD_6_AND_RIGHT_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_0_AND_INSERT,
+  KEYMAP_CONSUMER_FIRST + 6,     // AC_FIND
+  HID_KEYBOARD_SC_PAGE_UP,       // 0x60
+  KEYMAP_CONSUMER_FIRST + 5,     // AC_CUT
+  HID_KEYBOARD_SC_NUM_LOCK,
+  HID_KEYBOARD_SC_LEFT_SHIFT,
+  HID_KEYBOARD_SC_Z,
+  HID_KEYBOARD_SC_X,
+  HID_KEYBOARD_SC_C,
+  HID_KEYBOARD_SC_V,
+  HID_KEYBOARD_SC_B,             // 0x68
+  HID_KEYBOARD_SC_N,
+  HID_KEYBOARD_SC_M,
+  HID_KEYBOARD_SC_COMMA_AND_LESS_THAN_SIGN,
+  HID_KEYBOARD_SC_DOT_AND_GREATER_THAN_SIGN,
+  HID_KEYBOARD_SC_SLASH_AND_QUESTION_MARK,
+  HID_KEYBOARD_SC_RIGHT_SHIFT,
+  HID_KEYBOARD_SC_F14,           // Line Feed; KEY_LINEFEED (101) has no HID usage.
+  HID_KEYBOARD_SC_KEYPAD_1_AND_END, // 0x70
+  HID_KEYBOARD_SC_KEYPAD_2_AND_DOWN_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_3_AND_PAGE_DOWN,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_HELP,
+  HID_KEYBOARD_SC_CAPS_LOCK,
+  HID_KEYBOARD_SC_LEFT_GUI,      // 0x78
+  HID_KEYBOARD_SC_SPACE,
+  HID_KEYBOARD_SC_RIGHT_GUI,
+  HID_KEYBOARD_SC_PAGE_DOWN,
+  HID_KEYBOARD_SC_NON_US_BACKSLASH_AND_PIPE,
+  HID_KEYBOARD_SC_KEYPAD_PLUS,
+  0,
+  0
+};
+
+/** Keymap for Type 5 keyboards, from Sun scancode to HID usage. */
+static HidUsageID const KeyMap_Type5[128] PROGMEM = {
+  0,                             // 0x00
+  KEYMAP_CONSUMER_FIRST + 0,     // AC_STOP
+  KEYMAP_CONSUMER_FIRST + 8,     // VOLUME_DECREMENT
+  KEYMAP_CONSUMER_FIRST + 1,     // AC_REDO
+  KEYMAP_CONSUMER_FIRST + 7,     // VOLUME_INCREMENT
+  HID_KEYBOARD_SC_F1,
+  HID_KEYBOARD_SC_F2,
+  HID_KEYBOARD_SC_F10,
+  HID_KEYBOARD_SC_F3,            // 0x08
+  HID_KEYBOARD_SC_F11,
+  HID_KEYBOARD_SC_F4,
+  HID_KEYBOARD_SC_F12,
+  HID_KEYBOARD_SC_F5,
+  HID_KEYBOARD_SC_RIGHT_ALT,
+  HID_KEYBOARD_SC_F6,
+  HID_KEYBOARD_SC_F13,           // Unlabeled between Help and F1; KEY_MACRO (112) has no HID usage.
+  HID_KEYBOARD_SC_F7,            // 0x10
+  HID_KEYBOARD_SC_F8,
+  HID_KEYBOARD_SC_F9,
+  HID_KEYBOARD_SC_LEFT_ALT,
+  HID_KEYBOARD_SC_UP_ARROW,
+  HID_KEYBOARD_SC_PAUSE,
+  HID_KEYBOARD_SC_PRINT_SCREEN,
+  HID_KEYBOARD_SC_SCROLL_LOCK,
+  HID_KEYBOARD_SC_LEFT_ARROW,    // 0x18
+  HID_KEYBOARD_SC_MENU,
+  KEYMAP_CONSUMER_FIRST + 2,     // AC_UNDO
+  HID_KEYBOARD_SC_DOWN_ARROW,
+  HID_KEYBOARD_SC_RIGHT_ARROW,
+  HID_KEYBOARD_SC_ESCAPE,
+  HID_KEYBOARD_SC_1_AND_EXCLAMATION,
+  HID_KEYBOARD_SC_2_AND_AT,
+  HID_KEYBOARD_SC_3_AND_HASHMARK, // 0x20
+  HID_KEYBOARD_SC_4_AND_DOLLAR,
+  HID_KEYBOARD_SC_5_AND_PERCENTAGE,
+  HID_KEYBOARD_SC_6_AND_CARET,
+  HID_KEYBOARD_SC_7_AND_AMPERSAND,
+  HID_KEYBOARD_SC_8_AND_ASTERISK,
+  HID_KEYBOARD_SC_9_AND_OPENING_PARENTHESIS,
+  HID_KEYBOARD_SC_0_AND_CLOSING_PARENTHESIS,
+  HID_KEYBOARD_SC_MINUS_AND_UNDERSCORE, // 0x28
+  HID_KEYBOARD_SC_EQUAL_AND_PLUS,
+  HID_KEYBOARD_SC_GRAVE_ACCENT_AND_TILDE,
+  HID_KEYBOARD_SC_BACKSPACE,
+  HID_KEYBOARD_SC_INSERT,
+  KEYMAP_CONSUMER_FIRST + 9,     // MUTE
+  HID_KEYBOARD_SC_KEYPAD_SLASH,
+  HID_KEYBOARD_SC_KEYPAD_ASTERISK,
+  KEYMAP_SYSTEM_FIRST + 0,       // POWER_DOWN
+  HID_KEYBOARD_SC_SELECT,
+  HID_KEYBOARD_SC_KEYPAD_DOT_AND_DELETE,
+  KEYMAP_CONSUMER_FIRST + 3,     // AC_COPY
+  HID_KEYBOARD_SC_HOME,
+  HID_KEYBOARD_SC_TAB,
+  HID_KEYBOARD_SC_Q,
+  HID_KEYBOARD_SC_W,
+  HID_KEYBOARD_SC_E,             // 0x38
+  HID_KEYBOARD_SC_R,
+  HID_KEYBOARD_SC_T,
+  HID_KEYBOARD_SC_Y,
+  HID_KEYBOARD_SC_U,
+  HID_KEYBOARD_SC_I,
+  HID_KEYBOARD_SC_O,
+  HID_KEYBOARD_SC_P,
+  HID_KEYBOARD_SC_OPENING_BRACKET_AND_OPENING_BRACE, // 0x40
+  HID_KEYBOARD_SC_CLOSING_BRACKET_AND_CLOSING_BRACE,
+  HID_KEYBOARD_SC_DELETE,
+  HID_KEYBOARD_SC_APPLICATION,
+  HID_KEYBOARD_SC_KEYPAD_7_AND_HOME,
+  HID_KEYBOARD_SC_KEYPAD_8_AND_UP_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_9_AND_PAGE_UP,
+  HID_KEYBOARD_SC_KEYPAD_MINUS,
+  HID_KEYBOARD_SC_EXECUTE,       // 0x48
+  KEYMAP_CONSUMER_FIRST + 4,     // AC_PASTE
+  HID_KEYBOARD_SC_END,
+  0,
+  HID_KEYBOARD_SC_LEFT_CONTROL,
+  HID_KEYBOARD_SC_A,
+  HID_KEYBOARD_SC_S,
+  HID_KEYBOARD_SC_D,
+  HID_KEYBOARD_SC_F,             // 0x50
+  HID_KEYBOARD_SC_G,
+  HID_KEYBOARD_SC_H,
+  HID_KEYBOARD_SC_J,
+  HID_KEYBOARD_SC_K,
+  HID_KEYBOARD_SC_L,
+  HID_KEYBOARD_SC_SEMICOLON_AND_COLON,
+  HID_KEYBOARD_SC_APOSTROPHE_AND_QUOTE,
+  HID_KEYBOARD_SC_BACKSLASH_AND_PIPE, // 0x58
+  HID_KEYBOARD_SC_ENTER,
+  HID_KEYBOARD_SC_KEYPAD_ENTER,
+  HID_KEYBOARD_SC_KEYPAD_4_AND_LEFT_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_5,
+  HID_KEYBOARD_SC_KEYPAD_6_AND_RIGHT_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_0_AND_INSERT,
+  KEYMAP_CONSUMER_FIRST + 6,     // AC_FIND
+  HID_KEYBOARD_SC_PAGE_UP,       // 0x60
+  KEYMAP_CONSUMER_FIRST + 5,     // AC_CUT
+  HID_KEYBOARD_SC_NUM_LOCK,
+  HID_KEYBOARD_SC_LEFT_SHIFT,
+  HID_KEYBOARD_SC_Z,
+  HID_KEYBOARD_SC_X,
+  HID_KEYBOARD_SC_C,
+  HID_KEYBOARD_SC_V,
+  HID_KEYBOARD_SC_B,             // 0x68
+  HID_KEYBOARD_SC_N,
+  HID_KEYBOARD_SC_M,
+  HID_KEYBOARD_SC_COMMA_AND_LESS_THAN_SIGN,
+  HID_KEYBOARD_SC_DOT_AND_GREATER_THAN_SIGN,
+  HID_KEYBOARD_SC_SLASH_AND_QUESTION_MARK,
+  HID_KEYBOARD_SC_RIGHT_SHIFT,
+  HID_KEYBOARD_SC_F14,           // Line Feed; KEY_LINEFEED (101) has no HID usage.
+  HID_KEYBOARD_SC_KEYPAD_1_AND_END, // 0x70
+  HID_KEYBOARD_SC_KEYPAD_2_AND_DOWN_ARROW,
+  HID_KEYBOARD_SC_KEYPAD_3_AND_PAGE_DOWN,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_HELP,
+  HID_KEYBOARD_SC_CAPS_LOCK,
+  HID_KEYBOARD_SC_LEFT_GUI,      // 0x78
+  HID_KEYBOARD_SC_SPACE,
+  HID_KEYBOARD_SC_RIGHT_GUI,
+  HID_KEYBOARD_SC_PAGE_DOWN,
+  HID_KEYBOARD_SC_NON_US_BACKSLASH_AND_PIPE,
+  HID_KEYBOARD_SC_KEYPAD_PLUS,
+  0,
+  0
+};
+
+/** Layers defined, each a bit in the active layer mask. */
+#define LAYER_COUNT 3
+
+/** Keymap for each nonzero active layer mask, from Sun scancode to the HID usage of
+ *  the highest active layer that gives the key, or 0 for none.
+ */
+static HidUsageID const LayerMap[7][128] PROGMEM = {
+  { /* 1 */
+  0,                             // 0x00
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_F13,
+  HID_KEYBOARD_SC_F14,
+  HID_KEYBOARD_SC_F22,
+  HID_KEYBOARD_SC_F15,           // 0x08
+  HID_KEYBOARD_SC_F23,
+  HID_KEYBOARD_SC_F16,
+  HID_KEYBOARD_SC_F24,
+  HID_KEYBOARD_SC_F17,
+  0,
+  HID_KEYBOARD_SC_F18,
+  0,
+  HID_KEYBOARD_SC_F19,           // 0x10
+  HID_KEYBOARD_SC_F20,
+  HID_KEYBOARD_SC_F21,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x60
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+  },
+  { /* 2 */
+  0,                             // 0x00
+  HID_KEYBOARD_SC_STOP,
+  0,
+  HID_KEYBOARD_SC_AGAIN,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x08
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x10
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  HID_KEYBOARD_SC_MENU,          // Props
+  HID_KEYBOARD_SC_UNDO,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  HID_KEYBOARD_SC_COPY,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  HID_KEYBOARD_SC_PASTE,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_FIND,
+  0,                             // 0x60
+  HID_KEYBOARD_SC_CUT,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_HELP,
+  0,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+  },
+  { /* 1 2 */
+  0,                             // 0x00
+  HID_KEYBOARD_SC_STOP,
+  0,
+  HID_KEYBOARD_SC_AGAIN,
+  0,
+  HID_KEYBOARD_SC_F13,
+  HID_KEYBOARD_SC_F14,
+  HID_KEYBOARD_SC_F22,
+  HID_KEYBOARD_SC_F15,           // 0x08
+  HID_KEYBOARD_SC_F23,
+  HID_KEYBOARD_SC_F16,
+  HID_KEYBOARD_SC_F24,
+  HID_KEYBOARD_SC_F17,
+  0,
+  HID_KEYBOARD_SC_F18,
+  0,
+  HID_KEYBOARD_SC_F19,           // 0x10
+  HID_KEYBOARD_SC_F20,
+  HID_KEYBOARD_SC_F21,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  HID_KEYBOARD_SC_MENU,          // Props
+  HID_KEYBOARD_SC_UNDO,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  HID_KEYBOARD_SC_COPY,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  HID_KEYBOARD_SC_PASTE,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_FIND,
+  0,                             // 0x60
+  HID_KEYBOARD_SC_CUT,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_HELP,
+  0,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+  },
+  { /* 3 */
+  0,                             // 0x00
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x08
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x10
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x60
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_LEFT_CONTROL,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+  },
+  { /* 1 3 */
+  0,                             // 0x00
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_F13,
+  HID_KEYBOARD_SC_F14,
+  HID_KEYBOARD_SC_F22,
+  HID_KEYBOARD_SC_F15,           // 0x08
+  HID_KEYBOARD_SC_F23,
+  HID_KEYBOARD_SC_F16,
+  HID_KEYBOARD_SC_F24,
+  HID_KEYBOARD_SC_F17,
+  0,
+  HID_KEYBOARD_SC_F18,
+  0,
+  HID_KEYBOARD_SC_F19,           // 0x10
+  HID_KEYBOARD_SC_F20,
+  HID_KEYBOARD_SC_F21,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x60
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_LEFT_CONTROL,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+  },
+  { /* 2 3 */
+  0,                             // 0x00
+  HID_KEYBOARD_SC_STOP,
+  0,
+  HID_KEYBOARD_SC_AGAIN,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x08
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x10
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  HID_KEYBOARD_SC_MENU,          // Props
+  HID_KEYBOARD_SC_UNDO,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  HID_KEYBOARD_SC_COPY,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  HID_KEYBOARD_SC_PASTE,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_FIND,
+  0,                             // 0x60
+  HID_KEYBOARD_SC_CUT,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_HELP,
+  HID_KEYBOARD_SC_LEFT_CONTROL,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+  },
+  { /* 1 2 3 */
+  0,                             // 0x00
+  HID_KEYBOARD_SC_STOP,
+  0,
+  HID_KEYBOARD_SC_AGAIN,
+  0,
+  HID_KEYBOARD_SC_F13,
+  HID_KEYBOARD_SC_F14,
+  HID_KEYBOARD_SC_F22,
+  HID_KEYBOARD_SC_F15,           // 0x08
+  HID_KEYBOARD_SC_F23,
+  HID_KEYBOARD_SC_F16,
+  HID_KEYBOARD_SC_F24,
+  HID_KEYBOARD_SC_F17,
+  0,
+  HID_KEYBOARD_SC_F18,
+  0,
+  HID_KEYBOARD_SC_F19,           // 0x10
+  HID_KEYBOARD_SC_F20,
+  HID_KEYBOARD_SC_F21,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  HID_KEYBOARD_SC_MENU,          // Props
+  HID_KEYBOARD_SC_UNDO,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  HID_KEYBOARD_SC_COPY,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  HID_KEYBOARD_SC_PASTE,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_FIND,
+  0,                             // 0x60
+  HID_KEYBOARD_SC_CUT,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_HELP,
+  HID_KEYBOARD_SC_LEFT_CONTROL,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+  },
+};
+
+/** Dual-role keys, which send a usage of their own when tapped. */
+#define TAP_COUNT 1
+
+/** Usage sent when each Sun scancode is tapped, or 0 if it is not a dual-role key. */
+static HidUsageID const TapMap[128] PROGMEM = {
+  0,                             // 0x00
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x08
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x10
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x18
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x20
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x28
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x30
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x38
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x40
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x48
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x50
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x58
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x60
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x68
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,                             // 0x70
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  HID_KEYBOARD_SC_ESCAPE,
+  0,                             // 0x78
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0
+};
+
+/** Keyboard usage sent for each control to a boot protocol host, which has no control
+ *  reports, or 0 for none.
+ */
+static HidUsageID const ControlBootMap[0x100 - KEYMAP_CONSUMER_FIRST] PROGMEM = {
+  [0] = HID_KEYBOARD_SC_STOP,              // AC_STOP
+  [1] = HID_KEYBOARD_SC_AGAIN,             // AC_REDO
+  [2] = HID_KEYBOARD_SC_UNDO,              // AC_UNDO
+  [3] = HID_KEYBOARD_SC_COPY,              // AC_COPY
+  [4] = HID_KEYBOARD_SC_PASTE,             // AC_PASTE
+  [5] = HID_KEYBOARD_SC_CUT,               // AC_CUT
+  [6] = HID_KEYBOARD_SC_FIND,              // AC_FIND
+  [7] = HID_KEYBOARD_SC_VOLUME_UP,         // VOLUME_INCREMENT
+  [8] = HID_KEYBOARD_SC_VOLUME_DOWN,       // VOLUME_DECREMENT
+  [9] = HID_KEYBOARD_SC_MUTE,              // MUTE
+  [20] = HID_KEYBOARD_SC_POWER,            // POWER_DOWN
+};
+
+/** Keymap for a layout byte. */
+static const HidUsageID* KeyMap_ForLayout(uint8_t layout)
+{
+  if ((layout & 0x20) == 0x00) return KeyMap_Type4;
+  return KeyMap_Type5;
+}
+#endif
@@ -0,0 +1,71 @@
+/* 
+  Copyright 2015 Mike McMahon
+
+  LUFA Library
+  Copyright 2014  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Profiling markers for running the firmware under simavr.
+ *
+ *  When built with SUNKBD_PROFILE, each marked section writes its ID to
+ *  GPIOR0 on entry, and the ID with the top bit set on exit. The profiler
+ *  in test/sim watches that register and charges the cycles in between to
+ *  the section. Otherwise the markers compile to nothing.
+ */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#ifndef SUNKBD_PROFILE
+#define SUNKBD_PROFILE 0
+#endif
+
+/** Sections of the firmware that are marked for profiling. */
+enum ProfileSections_t
+{
+  PROFILE_MainLoop           = 1, /**< One pass of the main loop. */
+  PROFILE_SunKbdTask         = 2, /**< Keyboard bytes processed in the main loop. */
+  PROFILE_HIDTask            = 3, /**< LUFA HID class driver task. */
+  PROFILE_USBTask            = 4, /**< LUFA USB task, including control requests. */
+  PROFILE_CreateReport       = 5, /**< HID report creation callback. */
+  PROFILE_ProcessReport      = 6, /**< HID report processing callback. */
+  PROFILE_FirstISR           = 0x40,
+  PROFILE_RxISR              = 0x40, /**< USART receive interrupt. */
+  PROFILE_UdreISR            = 0x41, /**< USART data register empty interrupt. */
+  PROFILE_StartOfFrame       = 0x42, /**< USB start of frame, from the USB interrupt. */
+  PROFILE_TimerISR           = 0x43, /**< Millisecond timer compare interrupt. */
+  PROFILE_EEReadyISR         = 0x44, /**< EEPROM ready interrupt, writing settings. */
+};
+
+/** Set on the ID written when a section exits. */
+#define PROFILE_EXIT_FLAG 0x80
+
+#if SUNKBD_PROFILE
+#define PROFILE_ENTER(id) (GPIOR0 = (id))
+#define PROFILE_EXIT(id) (GPIOR0 = (id) | PROFILE_EXIT_FLAG)
+#else
+#define PROFILE_ENTER(id)
+#define PROFILE_EXIT(id)
+#endif
+
+#endif
@@ -0,0 +1,1927 @@
+/* 
+  Copyright 2015 Mike McMahon
+
+  LUFA Library
+  Copyright 2014  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ * Converter core: Sun keyboard protocol parser, key state and HID reports. This has no
+ * hardware dependencies, so that it can also be built and tested on the host.
+ */
+
+#include "SunKbd.h"
+
+uint8_t KeyboardLayout;
+uint8_t KeyboardType;
+static bool UsingReportProtocol = true;
+
+/*** Keyboard Map ***/
+
+// The keymaps for each keyboard family are generated from layouts.txt
+// by genlayouts.py. The one to use is picked when the layout byte
+// arrives. A remap table in RAM, indexed the same way, comes first: a
+// nonzero entry replaces the keymap's. It and the macro table are
+// uploaded by the host into a second buffer each; see Host Tables.
+//
+// Layers come before both. They are generated into flash as a keymap
+// for each combination of active layers, holding the entry from the
+// highest active layer that has the key, so the active layer mask picks
+// the keymap however many layers are on. A layer is active while any of
+// its layer keys is held, or from one press of its toggle key to the
+// next.
+//
+// A boot protocol host has no control reports, so for it the keys
+// that would go there give a keyboard usage instead, where there is
+// one. Which of these applies to a key only changes when the layout
+// byte arrives, a remap table is put in use, the layers change or the
+// host picks a protocol, which is rare next to keys. So the three are resolved into one keymap in RAM
+// then, and translating a key is a single byte read.
+
+#include "Layouts.h"
+
+static const HidUsageID* KeyMap;
+
+typedef struct
+{
+  uint8_t* InUse;
+  uint8_t* Staging;             // Being uploaded.
+  uint8_t Size;
+  uint8_t Loaded;               // Bit per piece loaded since Table_Begin().
+  bool Dirty;                   // InUse is not in EEPROM yet.
+  uint16_t CRC;                 // Of InUse, as written after it.
+  uint16_t EEPROMOffset;        // Of its first bank; the second follows.
+} Table_t;
+
+static uint8_t RemapBuffers[2][REMAP_KEYS];
+static uint8_t MacroBuffers[2][SUNKBD_MACRO_BYTES];
+
+#define TABLE_EEPROM_BASE       (SUNKBD_CONFIG_SLOTS * sizeof(Config_Record_t))
+
+static Table_t Tables[TABLE_Count] = {
+  [TABLE_Remap] = {
+    .InUse = RemapBuffers[0], .Staging = RemapBuffers[1], .Size = REMAP_KEYS,
+    .EEPROMOffset = TABLE_EEPROM_BASE
+  },
+  [TABLE_Macros] = {
+    .InUse = MacroBuffers[0], .Staging = MacroBuffers[1], .Size = SUNKBD_MACRO_BYTES,
+    .EEPROMOffset = TABLE_EEPROM_BASE + 2 * (REMAP_KEYS + sizeof(uint16_t))
+  },
+};
+
+#define IS_LAYER_CODE(usage)    ((uint8_t)((usage) - KEYMAP_LAYER_FIRST) < 2 * LAYERS_MAX)
+
+static uint8_t LayerHeld[LAYERS_MAX]; // Layer keys down for each layer.
+static uint8_t LayerToggled;          // Bit per layer.
+static uint8_t LayerMask;             // Bit per layer active.
+
+static HidUsageID ActiveKeyMap[REMAP_KEYS]; // Layers, remap and keymap resolved.
+
+/*** Key State ***/
+
+// Keys down are a bitmap indexed by Sun scancode, so that telling
+// whether a key is down is constant time. Press order, which decides
+// what goes into the six-key report, is a short list of the keys down,
+// along with the usage each was pressed as. It is bounded by what a
+// hand can hold down, rather than by the 128 scancodes, to keep RAM
+// for the tables: a press past KEYS_DOWN_MAX is dropped and counted,
+// and its release is then unmatched. A release takes the key out of
+// the list, keeping the order of the rest, which is a few bytes moved.
+
+#define KEY_NONE 0xFF
+
+#ifndef KEYS_DOWN_MAX
+#define KEYS_DOWN_MAX 16
+#endif
+
+static uint8_t KeyBitmap[(SUNKBD_KEY + 1) / 8];
+static uint8_t KeysDown[KEYS_DOWN_MAX];          // In press order.
+static HidUsageID KeysDownUsage[KEYS_DOWN_MAX];  // What each was pressed as.
+uint8_t NKeysDown;
+
+static void KeyState_Clear(void)
+{
+  memset(KeyBitmap, 0, sizeof(KeyBitmap));
+  NKeysDown = 0;
+}
+
+static bool KeyState_IsDown(uint8_t key)
+{
+  return (KeyBitmap[key >> 3] & (1 << (key & 7))) != 0;
+}
+
+/** Position of a key in the list of keys down, which it must be in. */
+static uint8_t KeyState_Index(uint8_t key)
+{
+  uint8_t i = NKeysDown;
+
+  while (KeysDown[--i] != key);  // Newest first: usually the one just pressed.
+  return i;
+}
+
+/** Add a key to the keys down, which must not be down already, nor the list full. */
+static void KeyState_Press(uint8_t key)
+{
+  KeyBitmap[key >> 3] |= 1 << (key & 7);
+  KeysDown[NKeysDown] = key;
+  KeysDownUsage[NKeysDown] = 0;
+  NKeysDown++;
+}
+
+/** Take a key, which must be down, out of the keys down, and return its usage. */
+static HidUsageID KeyState_Release(uint8_t key)
+{
+  HidUsageID usage;
+  uint8_t i;
+
+  KeyBitmap[key >> 3] &= ~(1 << (key & 7));
+  i = KeyState_Index(key);
+  usage = KeysDownUsage[i];
+  NKeysDown--;
+  for (; i < NKeysDown; i++) {
+    KeysDown[i] = KeysDown[i+1];
+    KeysDownUsage[i] = KeysDownUsage[i+1];
+  }
+  return usage;
+}
+
+#ifndef DEBUG_UNMAPPED
+#define DEBUG_UNMAPPED 0
+#endif
+
+#if DEBUG_UNMAPPED
+
+static HidUsageID encodeHighForDebug(uint8_t code) {
+  switch (code) {
+  case 0x00:
+    return HID_KEYBOARD_SC_G;
+  case 0x10:
+    return HID_KEYBOARD_SC_H;
+  case 0x20:
+    return HID_KEYBOARD_SC_I;
+  case 0x30:
+    return HID_KEYBOARD_SC_J;
+  case 0x40:
+    return HID_KEYBOARD_SC_K;
+  case 0x50:
+    return HID_KEYBOARD_SC_L;
+  case 0x60:
+    return HID_KEYBOARD_SC_M;
+  case 0x70:
+    return HID_KEYBOARD_SC_N;
+  case 0x80:
+    return HID_KEYBOARD_SC_O;
+  case 0x90:
+    return HID_KEYBOARD_SC_P;
+  case 0xA0:
+    return HID_KEYBOARD_SC_Q;
+  case 0xB0:
+    return HID_KEYBOARD_SC_R;
+  case 0xC0:
+    return HID_KEYBOARD_SC_S;
+  case 0xD0:
+    return HID_KEYBOARD_SC_T;
+  case 0xE0:
+    return HID_KEYBOARD_SC_U;
+  case 0xF0:
+    return HID_KEYBOARD_SC_V;
+  default:
+    return 0;
+  }
+}
+
+static HidUsageID encodeLowForDebug(uint8_t code) {
+  switch (code) {
+  case 0x00:
+    return HID_KEYBOARD_SC_0_AND_CLOSING_PARENTHESIS;
+  case 0x10:
+    return HID_KEYBOARD_SC_1_AND_EXCLAMATION;
+  case 0x02:
+    return HID_KEYBOARD_SC_2_AND_AT;
+  case 0x03:
+    return HID_KEYBOARD_SC_3_AND_HASHMARK;
+  case 0x04:
+    return HID_KEYBOARD_SC_4_AND_DOLLAR;
+  case 0x05:
+    return HID_KEYBOARD_SC_5_AND_PERCENTAGE;
+  case 0x06:
+    return HID_KEYBOARD_SC_6_AND_CARET;
+  case 0x07:
+    return HID_KEYBOARD_SC_7_AND_AMPERSAND;
+  case 0x08:
+    return HID_KEYBOARD_SC_8_AND_ASTERISK;
+  case 0x09:
+    return HID_KEYBOARD_SC_9_AND_OPENING_PARENTHESIS;
+  case 0x0A:
+    return HID_KEYBOARD_SC_A;
+  case 0x0B:
+    return HID_KEYBOARD_SC_B;
+  case 0x0C:
+    return HID_KEYBOARD_SC_C;
+  case 0x0D:
+    return HID_KEYBOARD_SC_D;
+  case 0x0E:
+    return HID_KEYBOARD_SC_E;
+  case 0x0F:
+    return HID_KEYBOARD_SC_F;
+  default:
+    return 0;
+  }
+}
+
+#endif
+
+/** Resolve the active layers, the remap table in use, the keymap and the protocol into
+ *  ActiveKeyMap.
+ */
+static void KeyMap_Resolve(void)
+{
+  const uint8_t* remap = Tables[TABLE_Remap].InUse;
+  HidUsageID usage;
+
+  for (uint8_t key = 0; key < REMAP_KEYS; key++) {
+    usage = 0;
+#if LAYER_COUNT > 0
+    if (LayerMask != 0) {
+      usage = pgm_read_byte(&LayerMap[LayerMask - 1][key]);
+    }
+#endif
+    if (usage == 0) usage = remap[key];
+    if (usage == 0) usage = pgm_read_byte(&KeyMap[key]);
+    if (!UsingReportProtocol && (usage >= KEYMAP_CONSUMER_FIRST) && !IS_LAYER_CODE(usage)) {
+      usage = pgm_read_byte(&ControlBootMap[usage - KEYMAP_CONSUMER_FIRST]);
+    }
+    ActiveKeyMap[key] = usage;
+  }
+}
+
+/** Switch to the keymap for the given layout byte. */
+static void KeyMap_Select(uint8_t layout)
+{
+  KeyMap = KeyMap_ForLayout(layout);
+  KeyMap_Resolve();
+}
+
+static HidUsageID TranslateKey(uint8_t key)
+{
+  return ActiveKeyMap[key];
+}
+
+/** Note that the active layers may have changed. */
+static void Layer_SetMask(uint8_t mask)
+{
+  if (mask == LayerMask) return;
+  LayerMask = mask;
+  KeyMap_Resolve();
+}
+
+/** Note that a key with a layer key usage has gone down or up. */
+static void Layer_Key(HidUsageID usage, bool pressed)
+{
+  uint8_t layer, mask;
+
+  if (usage >= KEYMAP_TOGGLE_FIRST) {
+    layer = usage - KEYMAP_TOGGLE_FIRST;
+    if (layer >= LAYER_COUNT) return;
+    if (pressed) LayerToggled ^= 1 << layer;
+  }
+  else {
+    layer = usage - KEYMAP_LAYER_FIRST;
+    if (layer >= LAYER_COUNT) return;
+    if (pressed) {
+      LayerHeld[layer]++;
+    }
+    else if (LayerHeld[layer] > 0) {
+      LayerHeld[layer]--;
+    }
+  }
+
+  mask = LayerToggled;
+  for (layer = 0; layer < LAYER_COUNT; layer++) {
+    if (LayerHeld[layer] != 0) mask |= 1 << layer;
+  }
+  Layer_SetMask(mask);
+}
+
+/*** Control Reports ***/
+
+// Keys that hosts only know on the Consumer page, and the Power key, go
+// to the host in reports of their own, so that they work without a
+// host keymap and do not take up the six keyboard slots. The Consumer
+// report is a bitmap of the controls down. The System Control report
+// holds the one control down, if any. A Power Down press is Wake Up
+// while the host is suspended, and Sleep with Shift down. The Power key
+// line and the keys in the keymap are kept apart, so that letting go of
+// the keys, as on a keyboard reset, leaves the line held. Changes to
+// both are queued apart from the keyboard reports, and only in report
+// protocol, since a boot protocol host has no way to get them; keys
+// pressed then give their keyboard usages instead, if they have one.
+
+#define CONTROL_QUEUE_SIZE 8
+#define CONTROL_QUEUE_MASK (CONTROL_QUEUE_SIZE - 1)
+
+static bool HostSuspended;
+static uint16_t ConsumerControls; // Bits down now.
+static uint8_t SystemUsage;       // Down now.
+static uint8_t SystemKey;         // Down from a key in the keymap.
+static uint8_t SystemLine;        // Down from the Power key line.
+static uint8_t ControlQueueReport[CONTROL_QUEUE_SIZE];
+static uint16_t ControlQueueValue[CONTROL_QUEUE_SIZE];
+static uint8_t ControlQueueHead, ControlQueueCount;
+
+static void Control_Enqueue(uint8_t report, uint16_t value)
+{
+  uint8_t index;
+
+  if (!UsingReportProtocol) return;
+
+  if (ControlQueueCount < CONTROL_QUEUE_SIZE) {
+    index = (ControlQueueHead + ControlQueueCount++) & CONTROL_QUEUE_MASK;
+  }
+  else {
+    index = (ControlQueueHead + CONTROL_QUEUE_SIZE - 1) & CONTROL_QUEUE_MASK;
+    ReportQueueOverflows++;
+  }
+  ControlQueueReport[index] = report;
+  ControlQueueValue[index] = value;
+}
+
+static void Control_Consumer(uint8_t bit, bool pressed)
+{
+  uint16_t controls;
+
+  controls = ConsumerControls;
+  if (pressed) {
+    controls |= 1 << bit;
+  }
+  else {
+    controls &= ~(1 << bit);
+  }
+  if (controls == ConsumerControls) return;
+  ConsumerControls = controls;
+  Control_Enqueue(CONTROL_REPORT_Consumer, controls);
+}
+
+/** Note a System Control press or release from one source, the key or the line. */
+static void Control_System(uint8_t* source, uint8_t usage, uint8_t modifiers, bool pressed)
+{
+  if (!pressed) {
+    usage = 0;
+  }
+  else if (usage == SYSTEM_CONTROL_POWER_DOWN) {
+    if (HostSuspended) {
+      usage = SYSTEM_CONTROL_WAKE_UP;
+    }
+    else if (modifiers & (HID_KEYBOARD_MODIFIER_LEFTSHIFT | HID_KEYBOARD_MODIFIER_RIGHTSHIFT)) {
+      usage = SYSTEM_CONTROL_SLEEP;
+    }
+  }
+  *source = usage;
+  usage = (SystemKey != 0) ? SystemKey : SystemLine;
+  if (usage == SystemUsage) return;
+  SystemUsage = usage;
+  Control_Enqueue(CONTROL_REPORT_System, usage);
+}
+
+/** Send the press or release of a keymap entry past the modifiers. */
+static void Control_Key(HidUsageID usage, uint8_t modifiers, bool pressed)
+{
+  if (usage >= KEYMAP_SYSTEM_FIRST) {
+    Control_System(&SystemKey, usage - KEYMAP_SYSTEM_FIRST + SYSTEM_CONTROL_POWER_DOWN,
+                   modifiers, pressed);
+  }
+  else {
+    Control_Consumer(usage - KEYMAP_CONSUMER_FIRST, pressed);
+  }
+}
+
+static void Control_Clear(void)
+{
+  if (ConsumerControls != 0) {
+    ConsumerControls = 0;
+    Control_Enqueue(CONTROL_REPORT_Consumer, 0);
+  }
+  Control_System(&SystemKey, 0, 0, false);
+}
+
+/** Number of control report changes waiting to be sent. */
+uint8_t Control_Pending(void)
+{
+  return ControlQueueCount;
+}
+
+/** Fill in a control report. If Dequeue is set, this is the next queued change, and which
+ *  report it is for is returned, or 0 if there is none. Otherwise, it is the current state
+ *  of the given report.
+ */
+uint8_t Control_Create(uint8_t report, void* ReportData, uint16_t* const ReportSize, bool Dequeue)
+{
+  uint16_t value;
+
+  if (Dequeue) {
+    if (ControlQueueCount == 0) return 0;
+    report = ControlQueueReport[ControlQueueHead];
+    value = ControlQueueValue[ControlQueueHead];
+    ControlQueueHead = (ControlQueueHead + 1) & CONTROL_QUEUE_MASK;
+    ControlQueueCount--;
+  }
+  else {
+    value = (report == CONTROL_REPORT_Consumer) ? ConsumerControls : SystemUsage;
+  }
+
+  if (report == CONTROL_REPORT_Consumer) {
+    ((USB_ConsumerReport_Data_t*)ReportData)->Controls = value;
+    *ReportSize = sizeof(USB_ConsumerReport_Data_t);
+  }
+  else {
+    ((USB_SystemControlReport_Data_t*)ReportData)->Usage = value;
+    *ReportSize = sizeof(USB_SystemControlReport_Data_t);
+  }
+  return report;
+}
+
+/*** Report State ***/
+
+// Reports are updated as keys go down and up, rather than rebuilt for
+// every poll, so creating one for the host is just a copy. The usage
+// of each key is remembered when it goes down, so that it is released
+// as the same usage even if the layout changes meanwhile.
+
+static USB_KeyboardReport_Data_t BootReport;
+#if KEYBOARD_NKRO
+static USB_NKROKeyboardReport_Data_t NKROReport;
+#endif
+static uint8_t NKeyCodes;       // Non-modifier usages down, including those past six.
+static uint8_t UsageHeld[HID_KEYBOARD_SC_RIGHT_GUI + 1]; // Keys and macro steps holding each usage.
+static bool ReportDirty;        // Changed since last queued.
+
+// A key whose usage is a macro code adds nothing to the report itself;
+// the usages the macro presses are kept here instead. See Macros.
+
+#define IS_MACRO_CODE(usage)    ((uint8_t)((usage) - KEYMAP_MACRO_FIRST) < KEYMAP_MACRO_COUNT)
+
+#ifndef MACRO_HELD_MAX
+#define MACRO_HELD_MAX 6
+#endif
+
+static HidUsageID MacroHeld[MACRO_HELD_MAX];
+static uint8_t NMacroHeld;
+static uint8_t MacroRequested;  // Macro code to start, plus one, or zero.
+static bool MacroPlaying;
+static uint8_t MacroPC;         // Offset of the next step in the macro table.
+static uint8_t MacroWait;       // Milliseconds left of a wait step.
+static HidUsageID MacroTapped;  // To release before the next step.
+
+// A dual-role key, one with a usage in TapMap, that gives a modifier or
+// a layer key is held back when it goes down. Released before the tap
+// time is up, with no other key pressed meanwhile, it is a tap: its tap
+// usage is pressed and released. Another key pressed first, or the tap
+// time running out, makes it held: its usage goes in the report then,
+// along with the other key, so that Control and C reach the host in the
+// same report and holding adds no latency to the keys held with. The
+// time is counted down by the millisecond tick, so it does not depend
+// on the host polling.
+
+#ifndef SUNKBD_TAP_MS
+#define SUNKBD_TAP_MS 200
+#endif
+
+static uint8_t TapKey = KEY_NONE; // Dual-role key down and not yet tap or held.
+static uint8_t TapTimer;          // Milliseconds until it is held.
+
+// Every change to the report is queued as a snapshot and the host is
+// sent one per poll, so that a press and release between two polls, or
+// the steps of a fast roll, are all seen in order. When the queue is
+// full, a change replaces the newest snapshot, so the host still ends
+// up with the right state. A snapshot the same as the newest one is not
+// queued. Once that has been sent its slot is not reused until the queue
+// wraps around, so it is still there to compare with.
+
+#ifndef REPORT_QUEUE_SIZE
+#define REPORT_QUEUE_SIZE 8
+#endif
+#define REPORT_QUEUE_MASK (REPORT_QUEUE_SIZE - 1)
+
+#if (REPORT_QUEUE_SIZE & REPORT_QUEUE_MASK) != 0
+#error REPORT_QUEUE_SIZE must be a power of two
+#endif
+
+static KeyboardReportBuffer_t ReportQueue[REPORT_QUEUE_SIZE];
+static uint16_t ReportQueueTime[REPORT_QUEUE_SIZE]; // When the first change in each arrived.
+static bool ReportQueueTimed[REPORT_QUEUE_SIZE];    // Not for changes the converter made itself.
+static uint8_t ReportQueueHead, ReportQueueCount;
+static uint16_t DequeuedTime;
+static bool DequeuedUnsent, DequeuedTimed;
+static bool ReportQueueStale;   // Newest snapshot is not in the protocol in use.
+
+uint16_t ReportQueueOverflows;
+
+static void Report_Clear(void)
+{
+  if ((BootReport.Modifier != 0) || (BootReport.KeyCode[0] != 0)) {
+    ReportDirty = true;         // Key codes are packed, so any key down is in the first.
+  }
+  memset(&BootReport, 0, sizeof(BootReport));
+#if KEYBOARD_NKRO
+  memset(&NKROReport, 0, sizeof(NKROReport));
+#endif
+  NKeyCodes = 0;
+  memset(UsageHeld, 0, sizeof(UsageHeld));
+  Control_Clear();
+  memset(LayerHeld, 0, sizeof(LayerHeld));
+  Layer_SetMask(LayerToggled);
+  TapKey = KEY_NONE;
+  NMacroHeld = 0;
+  MacroRequested = 0;
+  MacroPlaying = false;
+  MacroWait = 0;
+  MacroTapped = 0;
+}
+
+/** Copy the report for the protocol in use and return its size. */
+static uint8_t Report_Copy(void* dest)
+{
+#if KEYBOARD_NKRO
+  if (UsingReportProtocol) {
+    memcpy(dest, &NKROReport, sizeof(NKROReport));
+    return sizeof(NKROReport);
+  }
+#endif
+  memcpy(dest, &BootReport, sizeof(BootReport));
+  return sizeof(BootReport);
+}
+
+/** True if the report differs from the newest snapshot queued, or the last one sent. */
+static bool Report_Changed(void)
+{
+  const KeyboardReportBuffer_t* newest;
+
+  if (ReportQueueStale) return true;
+  newest = &ReportQueue[(ReportQueueHead + ReportQueueCount - 1) & REPORT_QUEUE_MASK];
+#if KEYBOARD_NKRO
+  if (UsingReportProtocol) {
+    return memcmp(&NKROReport, &newest->NKRO, sizeof(NKROReport)) != 0;
+  }
+#endif
+  return memcmp(&BootReport, &newest->Boot, sizeof(BootReport)) != 0;
+}
+
+static void Report_Enqueue(uint16_t time, bool timed)
+{
+  uint8_t index;
+
+  ReportDirty = false;
+  if (!Report_Changed()) {
+    ReportsSuppressed++;
+    return;
+  }
+  ReportQueueStale = false;
+  if (ReportQueueCount < REPORT_QUEUE_SIZE) {
+    index = (ReportQueueHead + ReportQueueCount++) & REPORT_QUEUE_MASK;
+    ReportQueueTime[index] = time;
+    ReportQueueTimed[index] = timed;
+  }
+  else {
+    index = (ReportQueueHead + REPORT_QUEUE_SIZE - 1) & REPORT_QUEUE_MASK;
+    ReportQueueOverflows++;
+  }
+  Report_Copy(&ReportQueue[index]);
+}
+
+/** Add a usage to the six-key array being refilled, which has n so far, unless it is there. */
+static uint8_t Report_FillKeyCode(uint8_t n, HidUsageID usage)
+{
+  uint8_t i;
+
+  for (i = 0; i < n; i++) {
+    if (BootReport.KeyCode[i] == usage) return n; // Held by an earlier key too.
+  }
+  if (n < sizeof(BootReport.KeyCode)) {
+    BootReport.KeyCode[n++] = usage;
+  }
+  return n;
+}
+
+/** Refill the six-key array from all the keys down, in the order they went down. */
+static void Report_FillKeyCodes(void)
+{
+  HidUsageID usage;
+  uint8_t i, n;
+
+  if (NKeyCodes > sizeof(BootReport.KeyCode)) {
+    memset(BootReport.KeyCode, HID_KEYBOARD_SC_ERROR_ROLLOVER, sizeof(BootReport.KeyCode));
+    return;
+  }
+
+  n = 0;
+  for (i = 0; i < NKeysDown; i++) {
+    usage = KeysDownUsage[i];
+    if (usage == 0) {
+#if DEBUG_UNMAPPED
+      if (n+3 <= sizeof(BootReport.KeyCode)) {
+        BootReport.KeyCode[n++] = HID_KEYBOARD_SC_X;
+        BootReport.KeyCode[n++] = encodeHighForDebug(KeysDown[i] & 0xF0);
+        BootReport.KeyCode[n++] = encodeLowForDebug(KeysDown[i] & 0x0F);
+      }
+#endif
+    }
+    else if ((usage < HID_KEYBOARD_SC_LEFT_CONTROL) && !IS_MACRO_CODE(usage)) {
+      n = Report_FillKeyCode(n, usage);
+    }
+  }
+  for (i = 0; i < NMacroHeld; i++) {
+    usage = MacroHeld[i];
+    if (usage < HID_KEYBOARD_SC_LEFT_CONTROL) {
+      n = Report_FillKeyCode(n, usage);
+    }
+  }
+
+  while (n < sizeof(BootReport.KeyCode)) {
+    BootReport.KeyCode[n++] = 0;
+  }
+}
+
+static void Report_AddUsage(HidUsageID usage)
+{
+  uint8_t n;
+
+  if (usage >= KEYMAP_CONSUMER_FIRST) {
+    Control_Key(usage, BootReport.Modifier, true);
+    return;
+  }
+  if ((usage != 0) && (UsageHeld[usage]++ != 0)) return; // Already held by another key.
+
+  if (usage >= HID_KEYBOARD_SC_LEFT_CONTROL) {
+    // Modifier bits are in usage order.
+    BootReport.Modifier |= 1 << (usage - HID_KEYBOARD_SC_LEFT_CONTROL);
+#if KEYBOARD_NKRO
+    NKROReport.Modifier = BootReport.Modifier;
+#endif
+  }
+  else if (usage != 0) {
+#if KEYBOARD_NKRO
+    NKROReport.KeyBitmap[usage >> 3] |= 1 << (usage & 7);
+#endif
+    n = NKeyCodes++;
+    if (n < sizeof(BootReport.KeyCode)) {
+      BootReport.KeyCode[n] = usage;
+    }
+    else if (n == sizeof(BootReport.KeyCode)) {
+      memset(BootReport.KeyCode, HID_KEYBOARD_SC_ERROR_ROLLOVER, sizeof(BootReport.KeyCode));
+      RolloverEvents++;
+    }
+  }
+#if !DEBUG_UNMAPPED
+  else {
+    return;
+  }
+#else
+  Report_FillKeyCodes();
+#endif
+
+  ReportDirty = true;
+}
+
+static void Report_RemoveUsage(HidUsageID usage)
+{
+  uint8_t i, n;
+
+  if (usage >= KEYMAP_CONSUMER_FIRST) {
+    Control_Key(usage, BootReport.Modifier, false);
+    return;
+  }
+  if ((usage != 0) && ((UsageHeld[usage] == 0) || (--UsageHeld[usage] != 0))) {
+    return;                     // Still held by another key.
+  }
+
+  if (usage >= HID_KEYBOARD_SC_LEFT_CONTROL) {
+    BootReport.Modifier &= ~(1 << (usage - HID_KEYBOARD_SC_LEFT_CONTROL));
+#if KEYBOARD_NKRO
+    NKROReport.Modifier = BootReport.Modifier;
+#endif
+  }
+  else if (usage != 0) {
+#if KEYBOARD_NKRO
+    NKROReport.KeyBitmap[usage >> 3] &= ~(1 << (usage & 7));
+#endif
+    n = --NKeyCodes;
+    if (n == sizeof(BootReport.KeyCode)) {
+      Report_FillKeyCodes();    // No longer rolled over.
+    }
+    else if (n < sizeof(BootReport.KeyCode)) {
+      for (i = 0; i < n; i++) {
+        if (BootReport.KeyCode[i] == usage) break;
+      }
+      while (i < n) {
+        BootReport.KeyCode[i] = BootReport.KeyCode[i+1];
+        i++;
+      }
+      BootReport.KeyCode[n] = 0;
+    }
+  }
+#if !DEBUG_UNMAPPED
+  else {
+    return;
+  }
+#else
+  Report_FillKeyCodes();
+#endif
+
+  ReportDirty = true;
+}
+
+static bool Tap_IsDualRole(uint8_t key, HidUsageID usage)
+{
+#if TAP_COUNT > 0
+  if (pgm_read_byte(&TapMap[key]) == 0) return false;
+  return ((usage >= HID_KEYBOARD_SC_LEFT_CONTROL) && (usage <= HID_KEYBOARD_SC_RIGHT_GUI)) ||
+    IS_LAYER_CODE(usage);
+#else
+  return false;
+#endif
+}
+
+/** Tap time in milliseconds from the settings, or the default. */
+static uint8_t Tap_Time(void)
+{
+  if ((Config.TapTime == 0) || (Config.TapTime == 0xFF)) return SUNKBD_TAP_MS;
+  return Config.TapTime;
+}
+
+/** Make the dual-role key waiting, if any, held. */
+static void Tap_Hold(void)
+{
+  HidUsageID usage;
+
+  if (TapKey == KEY_NONE) return;
+  usage = KeysDownUsage[KeyState_Index(TapKey)];
+  TapKey = KEY_NONE;
+  if (IS_LAYER_CODE(usage)) {
+    Layer_Key(usage, true);
+  }
+  else {
+    Report_AddUsage(usage);
+  }
+}
+
+/** Send the tap usage of the dual-role key waiting, which has been released at the given
+ *  timer tick.
+ */
+static void Tap_Tap(uint16_t time)
+{
+#if TAP_COUNT > 0
+  HidUsageID usage;
+
+  usage = pgm_read_byte(&TapMap[TapKey]);
+  TapKey = KEY_NONE;
+  Report_AddUsage(usage);
+  if (ReportDirty) {
+    Report_Enqueue(time, true);
+  }
+  Report_RemoveUsage(usage);
+#endif
+}
+
+static void Tap_MillisecondElapsed(void)
+{
+  if ((TapKey == KEY_NONE) || (--TapTimer != 0)) return;
+  Tap_Hold();
+  if (ReportDirty) {
+    Report_Enqueue(0, false);   // Held as long as the tap time, which is not latency.
+  }
+}
+
+static void Report_AddKey(uint8_t key)
+{
+  HidUsageID usage;
+
+  Tap_Hold();                   // Another key, so not a tap.
+  usage = TranslateKey(key);
+  KeysDownUsage[KeyState_Index(key)] = usage;
+  if (Tap_IsDualRole(key, usage)) {
+    TapKey = key;
+    TapTimer = Tap_Time();
+    return;
+  }
+  if (IS_LAYER_CODE(usage)) {
+    Layer_Key(usage, true);
+    return;
+  }
+  if (IS_MACRO_CODE(usage)) {
+    MacroRequested = usage - KEYMAP_MACRO_FIRST + 1;
+    return;
+  }
+  Report_AddUsage(usage);
+}
+
+/** Take a key, pressed as the given usage, out of the report. It was released at the given
+ *  timer tick.
+ */
+static void Report_RemoveKey(uint8_t key, HidUsageID usage, uint16_t time)
+{
+  if (key == TapKey) {
+    Tap_Tap(time);
+    return;
+  }
+  if (IS_LAYER_CODE(usage)) {
+    Layer_Key(usage, false);
+    return;
+  }
+  if (IS_MACRO_CODE(usage)) return; // It plays to the end.
+  Report_RemoveUsage(usage);
+}
+
+/*** Latency ***/
+
+// Recorded as each queued report goes to the endpoint, from the time the
+// byte with its first change arrived; see Report_Sent().
+
+Latency_Data_t Latency;
+
+void Latency_Clear(void)
+{
+  memset(&Latency, 0, sizeof(Latency));
+  Latency.Min = 0xFFFF;
+}
+
+static void Latency_Record(uint16_t ticks)
+{
+  uint8_t bucket;
+  uint16_t rest;
+
+  if (ticks < Latency.Min) Latency.Min = ticks;
+  if (ticks > Latency.Max) Latency.Max = ticks;
+
+  bucket = 0;
+  for (rest = ticks; rest != 0; rest >>= 1) {
+    bucket++;
+  }
+  if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+  if (Latency.Buckets[bucket] != 0xFFFF) Latency.Buckets[bucket]++;
+}
+
+/*** Macros ***/
+
+// A key mapped to one of the macro codes plays that macro from the
+// macro table: macro n starts after the n-th MACRO_END. The steps are
+// run from the millisecond tick, and only once the host has taken every
+// queued report, so each press and release reaches the host as its own
+// report, a poll apart, and a wait step never holds anything else up.
+// Keys typed meanwhile are queued as usual, between the steps. A macro
+// key pressed while another macro plays stops that one first.
+
+/** Start playing the given macro, if the table has that many. */
+static void Macro_Start(uint8_t macro)
+{
+  const uint8_t* steps = Tables[TABLE_Macros].InUse;
+  uint8_t pc = 0;
+
+  while (macro > 0) {
+    if (pc >= SUNKBD_MACRO_BYTES) return;
+    if (steps[pc] == MACRO_END) {
+      macro--;
+      pc++;
+    }
+    else {
+      pc += 2;
+    }
+  }
+  MacroPC = pc;
+  MacroPlaying = true;
+}
+
+static void Macro_Press(HidUsageID usage)
+{
+  uint8_t i;
+
+  if ((usage == 0) || IS_MACRO_CODE(usage) || IS_LAYER_CODE(usage) ||
+      (NMacroHeld >= MACRO_HELD_MAX)) return;
+  for (i = 0; i < NMacroHeld; i++) {
+    if (MacroHeld[i] == usage) return;
+  }
+  MacroHeld[NMacroHeld++] = usage;
+  Report_AddUsage(usage);
+}
+
+static void Macro_Release(HidUsageID usage)
+{
+  uint8_t i;
+
+  for (i = 0; i < NMacroHeld; i++) {
+    if (MacroHeld[i] == usage) break;
+  }
+  if (i == NMacroHeld) return;
+  MacroHeld[i] = MacroHeld[--NMacroHeld];
+  Report_RemoveUsage(usage);
+}
+
+/** Stop the macro playing, if any, and release what it holds. */
+static void Macro_Stop(void)
+{
+  while (NMacroHeld > 0) {
+    Macro_Release(MacroHeld[NMacroHeld - 1]);
+  }
+  MacroPlaying = false;
+  MacroWait = 0;
+  MacroTapped = 0;
+  if (ReportDirty) {
+    Report_Enqueue(0, false);
+  }
+}
+
+static void Macro_MillisecondElapsed(void)
+{
+  const uint8_t* steps = Tables[TABLE_Macros].InUse;
+  uint8_t step, arg;
+
+  if (MacroRequested != 0) {
+    Macro_Stop();
+    Macro_Start(MacroRequested - 1);
+    MacroRequested = 0;
+  }
+  if (!MacroPlaying) return;
+  if ((MacroWait != 0) && (--MacroWait != 0)) return;
+  if ((ReportQueueCount != 0) || (ControlQueueCount != 0)) return;
+
+  if (MacroTapped != 0) {
+    Macro_Release(MacroTapped);
+    MacroTapped = 0;
+  }
+  // Run steps until one changes what the host sees.
+  while (MacroPlaying && !ReportDirty && (ControlQueueCount == 0) && (MacroWait == 0)) {
+    if (MacroPC + 1 >= SUNKBD_MACRO_BYTES) {
+      Macro_Stop();             // No room for another step.
+      break;
+    }
+    step = steps[MacroPC++];
+    if (step == MACRO_END) {
+      Macro_Stop();
+      break;
+    }
+    arg = steps[MacroPC++];
+    switch (step) {
+    case MACRO_PRESS:
+      Macro_Press(arg);
+      break;
+    case MACRO_RELEASE:
+      Macro_Release(arg);
+      break;
+    case MACRO_TAP:
+      Macro_Press(arg);
+      MacroTapped = arg;
+      break;
+    case MACRO_WAIT:
+      MacroWait = arg;
+      break;
+    }
+  }
+  if (ReportDirty) {
+    Report_Enqueue(0, false);
+  }
+}
+
+/*** Settings ***/
+
+// Settings that outlive a power cycle are kept in RAM and written to
+// EEPROM as one record, a while after the last change, so that a host
+// flipping a setting back and forth costs one write and not one each
+// time. Each record goes to the next of several slots in turn, to
+// spread the wear, with a sequence number and a CRC: loading takes the
+// newest good record, so a write cut short by a power loss leaves the
+// one before it in force. The remap and macro tables are too big to go
+// in every slot, so each has two banks of its own, with a CRC each: a
+// new table is written to the bank not in use and then a record naming
+// that bank. One table goes with each record written.
+// The bytes are taken one at a time by the EEPROM ready interrupt, as
+// commands to the keyboard are by the transmit interrupt, since each
+// takes 3.4 ms to write.
+
+#ifndef SUNKBD_CONFIG_COMMIT_MS
+#define SUNKBD_CONFIG_COMMIT_MS 5000
+#endif
+
+Config_Data_t Config;
+
+static Config_Record_t ConfigRecord; // Last written or loaded.
+static uint8_t ConfigSlot;           // Where ConfigRecord is.
+static volatile uint8_t ConfigWriteIndex;
+static uint8_t ConfigWriteSize;      // Bytes in this write: table bank, if any, then record.
+static uint8_t ConfigWriteTable;     // Bytes of table bank in it.
+static uint8_t ConfigWriteWhich;     // Which table.
+static uint16_t ConfigTimer;         // Milliseconds until a change is written.
+
+static uint16_t Config_CRC(const void* data, uint8_t size)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint16_t crc = 0xFFFF;
+
+  for (uint8_t i = 0; i < size; i++) {
+    crc = _crc_ccitt_update(crc, bytes[i]);
+  }
+  return crc;
+}
+
+static bool Config_Writing(void)
+{
+  return ConfigWriteIndex < ConfigWriteSize;
+}
+
+/** Offset in EEPROM of the bank of the given table that the given settings name. */
+static uint16_t Config_TableOffset(uint8_t table, const Config_Data_t* data)
+{
+  uint16_t offset = Tables[table].EEPROMOffset;
+
+  if (data->Banks & (1 << table)) {
+    offset += Tables[table].Size + sizeof(uint16_t);
+  }
+  return offset;
+}
+
+static void Config_LoadTable(uint8_t table)
+{
+  Table_t* t = &Tables[table];
+  uint16_t offset, crc;
+
+  offset = Config_TableOffset(table, &Config);
+  for (uint8_t i = 0; i < t->Size; i++) {
+    t->InUse[i] = SunKbd_ReadConfig(offset + i);
+  }
+  crc = SunKbd_ReadConfig(offset + t->Size) | (SunKbd_ReadConfig(offset + t->Size + 1) << 8);
+  if (crc != Config_CRC(t->InUse, t->Size)) {
+    memset(t->InUse, 0, t->Size);
+  }
+  t->CRC = crc;
+  t->Dirty = false;
+  if (table == TABLE_Remap) KeyMap_Resolve();
+}
+
+/** Load the settings from the newest good record in EEPROM, or the defaults if there is none. */
+void Config_Load(void)
+{
+  Config_Record_t record;
+  bool found = false;
+
+  for (uint8_t slot = 0; slot < SUNKBD_CONFIG_SLOTS; slot++) {
+    for (uint8_t i = 0; i < sizeof(record); i++) {
+      ((uint8_t*)&record)[i] = SunKbd_ReadConfig(slot * sizeof(record) + i);
+    }
+    if ((record.Version != CONFIG_VERSION) ||
+        (record.CRC != Config_CRC(&record, offsetof(Config_Record_t, CRC)))) continue;
+    // Live records are within a few of each other, so this holds across the wrap.
+    if (found && ((int8_t)(record.Sequence - ConfigRecord.Sequence) <= 0)) continue;
+    ConfigRecord = record;
+    ConfigSlot = slot;
+    found = true;
+  }
+
+  if (!found) {
+    memset(&ConfigRecord, 0, sizeof(ConfigRecord));
+    ConfigSlot = SUNKBD_CONFIG_SLOTS - 1; // So that the first record goes in slot 0.
+  }
+  Config = ConfigRecord.Data;
+  for (uint8_t table = 0; table < TABLE_Count; table++) {
+    Config_LoadTable(table);
+  }
+}
+
+/** Note that Config has changed. It is written once it has been left alone for a while. */
+void Config_Changed(void)
+{
+  ConfigTimer = SUNKBD_CONFIG_COMMIT_MS;
+}
+
+static void Config_Commit(void)
+{
+  Table_t* t;
+  uint8_t table, bytes;
+
+  if (Config_Writing()) {
+    ConfigTimer = 1;            // Still writing the last one; try again shortly.
+    return;
+  }
+  ConfigTimer = 0;
+
+  for (table = 0; table < TABLE_Count; table++) {
+    if (Tables[table].Dirty) break;
+  }
+  bytes = 0;
+  if (table < TABLE_Count) {
+    t = &Tables[table];
+    t->Dirty = false;
+    t->CRC = Config_CRC(t->InUse, t->Size);
+    Config.Banks ^= 1 << table;
+    bytes = t->Size + sizeof(t->CRC);
+    for (uint8_t other = table + 1; other < TABLE_Count; other++) {
+      if (Tables[other].Dirty) ConfigTimer = 1; // Next, once this one is written.
+    }
+  }
+  else if (!memcmp(&ConfigRecord.Data, &Config, sizeof(Config))) {
+    return;                     // Changed back.
+  }
+
+  ConfigSlot = (ConfigSlot + 1) % SUNKBD_CONFIG_SLOTS;
+  ConfigRecord.Sequence++;
+  ConfigRecord.Version = CONFIG_VERSION;
+  ConfigRecord.Data = Config;
+  ConfigRecord.CRC = Config_CRC(&ConfigRecord, offsetof(Config_Record_t, CRC));
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ConfigWriteTable = bytes;
+    ConfigWriteWhich = table;
+    ConfigWriteSize = bytes + sizeof(ConfigRecord);
+    ConfigWriteIndex = 0;
+  }
+  SunKbd_StartConfigWrite();
+}
+
+static void Config_MillisecondElapsed(void)
+{
+  if ((ConfigTimer != 0) && (--ConfigTimer == 0)) {
+    Config_Commit();
+  }
+}
+
+/** Next byte of settings to write to EEPROM, at the given offset into the records, or -1 if
+ *  there is nothing to write. Called from the EEPROM ready interrupt.
+ */
+int16_t SunKbd_NextConfigByte(uint16_t* offset)
+{
+  uint8_t index;
+
+  index = ConfigWriteIndex;
+  if (index >= ConfigWriteSize) return -1;
+  ConfigWriteIndex = index + 1;
+  if (index < ConfigWriteTable) {
+    const Table_t* t = &Tables[ConfigWriteWhich];
+    *offset = Config_TableOffset(ConfigWriteWhich, &ConfigRecord.Data) + index;
+    return (index < t->Size) ? t->InUse[index] : ((const uint8_t*)&t->CRC)[index - t->Size];
+  }
+  index -= ConfigWriteTable;
+  *offset = ConfigSlot * sizeof(ConfigRecord) + index;
+  return ((const uint8_t*)&ConfigRecord)[index];
+}
+
+/*** Keyboard Commands ***/
+
+// Commands to the keyboard are queued here and taken one byte at a
+// time by the transmit interrupt, so that no caller waits on the 1200
+// baud line, which costs more than 8 ms per byte. One-shot commands go
+// through a small queue. LED and click settings are latest-wins: a new
+// setting replaces one that has not been sent yet. While the host is
+// suspended, the keyboard is sent LEDs off and no click instead, and
+// the host's settings are sent again when it resumes.
+
+#ifndef SUNKBD_TX_QUEUE_SIZE
+#define SUNKBD_TX_QUEUE_SIZE 8
+#endif
+#define SUNKBD_TX_QUEUE_MASK (SUNKBD_TX_QUEUE_SIZE - 1)
+
+#if (SUNKBD_TX_QUEUE_SIZE & SUNKBD_TX_QUEUE_MASK) != 0
+#error SUNKBD_TX_QUEUE_SIZE must be a power of two
+#endif
+
+#define TX_PENDING_LEDS         (1 << 0)
+#define TX_PENDING_LEDS_MASK    (1 << 1) // SETLED sent, mask byte next.
+#define TX_PENDING_CLICK        (1 << 2)
+
+static volatile uint8_t TxQueue[SUNKBD_TX_QUEUE_SIZE];
+static volatile uint8_t TxHead, TxTail;
+static volatile uint8_t TxPending;
+static volatile uint8_t TxLEDMask;
+static volatile bool TxClick;
+static volatile bool TxBlank;   // Host suspended.
+
+volatile uint16_t TxQueued;
+volatile uint16_t TxCoalesced;
+
+/** Next byte to send to the keyboard, or -1 if there is nothing to send. Called from the
+ *  transmit interrupt.
+ */
+int16_t SunKbd_NextCommandByte(void)
+{
+  uint8_t tail, pending;
+
+  pending = TxPending;
+  if (pending & TX_PENDING_LEDS_MASK) {
+    TxPending = pending & ~TX_PENDING_LEDS_MASK;
+    return TxBlank ? 0 : TxLEDMask;
+  }
+
+  tail = TxTail;
+  if (tail != TxHead) {
+    TxTail = (tail + 1) & SUNKBD_TX_QUEUE_MASK;
+    return TxQueue[tail];
+  }
+
+  if (pending & TX_PENDING_LEDS) {
+    TxPending = (pending & ~TX_PENDING_LEDS) | TX_PENDING_LEDS_MASK;
+    return SUNKBD_CMD_SETLED;
+  }
+
+  if (pending & TX_PENDING_CLICK) {
+    TxPending = pending & ~TX_PENDING_CLICK;
+    return (TxClick && !TxBlank) ? SUNKBD_CMD_CLICK : SUNKBD_CMD_NOCLICK;
+  }
+
+  return -1;
+}
+
+/** Queue a one-shot command byte to the keyboard. Safe from interrupt context. */
+void SunKbd_SendCommand(uint8_t cmd)
+{
+  uint8_t head, next;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    head = TxHead;
+    next = (head + 1) & SUNKBD_TX_QUEUE_MASK;
+    if (next == TxTail) {
+      TxCoalesced++;
+    }
+    else {
+      TxQueue[head] = cmd;
+      TxHead = next;
+      TxQueued++;
+      SunKbd_StartTransmit();
+    }
+  }
+}
+
+void SunKbd_SetLEDs(uint8_t LEDMask)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TxLEDMask = LEDMask;
+    if (TxPending & TX_PENDING_LEDS) {
+      TxCoalesced++;
+    }
+    else {
+      TxPending |= TX_PENDING_LEDS;
+      TxQueued++;
+      SunKbd_StartTransmit();
+    }
+  }
+}
+
+void SunKbd_SetClick(bool enabled)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TxClick = enabled;
+    if (TxPending & TX_PENDING_CLICK) {
+      TxCoalesced++;
+    }
+    else {
+      TxPending |= TX_PENDING_CLICK;
+      TxQueued++;
+      SunKbd_StartTransmit();
+    }
+  }
+}
+
+/** Send the LED and click settings again, as after a reset. */
+static void Tx_SendSettings(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TxPending |= TX_PENDING_LEDS | TX_PENDING_CLICK;
+    TxQueued += 2;
+    SunKbd_StartTransmit();
+  }
+}
+
+/** Turn the keyboard LEDs and click off while the host is suspended, or back to the host's
+ *  settings when it resumes. A settings change waiting to be written is written at once.
+ */
+void SunKbd_Suspend(bool suspended)
+{
+  HostSuspended = suspended;
+  if (suspended && (ConfigTimer != 0)) {
+    Config_Commit();            // The host may cut the power next.
+  }
+  if (suspended == TxBlank) return;
+  TxBlank = suspended;
+  Tx_SendSettings();
+}
+
+/*** Startup ***/
+
+// The keyboard is reset when the converter starts, and then asked for
+// its layout. Each step has a timeout and is retried, and a step that
+// never gets an answer is skipped, so a slow keyboard or a lost byte
+// does not leave the converter waiting. A reset turns off the LEDs and
+// click, so they are sent again at the end.
+//
+// Keyboards are plugged and unplugged while the converter runs. A break
+// on the line, or no answer to the layout query that is sent after a
+// second of quiet, means that the keyboard is gone: any keys it had
+// down are released, and it is sent a reset every second. A keyboard
+// answers a reset, and sends one by itself when plugged in; either way,
+// it is then started up like the first one.
+
+#define STARTUP_RESET_TIMEOUT_MS  1000 // Self test takes a while.
+#define STARTUP_LAYOUT_TIMEOUT_MS 100
+#define STARTUP_RETRIES           3
+
+#ifndef SUNKBD_PROBE_MS
+#define SUNKBD_PROBE_MS           1000
+#endif
+
+#define SUNKBD_TYPE_4             0x04 // Type 4 and Type 5; Type 3 cannot tell its layout.
+
+enum StartupStates_t
+{
+  STARTUP_Idle,
+  STARTUP_Reset,
+  STARTUP_Layout,
+  STARTUP_Probe,                // Layout asked to see if the keyboard is still there.
+  STARTUP_Lost,
+};
+
+static uint8_t StartupState;
+static uint8_t StartupRetries;
+static uint16_t StartupTimer;
+static uint16_t LineQuiet;      // Milliseconds since the last byte from the keyboard.
+
+static void Keys_ReleaseAll(void)
+{
+  if (NKeysDown == 0) return;
+  KeyState_Clear();
+  Report_Clear();
+}
+
+/** Release any keys still down when the keyboard says none are, as their releases were lost.
+ *  Unlike a reset, this leaves a macro playing: ALLUP follows the release of its key.
+ */
+static void Keys_AllUp(void)
+{
+  uint8_t key;
+
+  TapKey = KEY_NONE;            // Not a tap without its release.
+  while (NKeysDown > 0) {
+    key = KeysDown[0];
+    Report_RemoveKey(key, KeyState_Release(key), 0);
+  }
+}
+
+static void Startup_Send(void)
+{
+  switch (StartupState) {
+  case STARTUP_Reset:
+    SunKbd_SendCommand(SUNKBD_CMD_RESET);
+    StartupTimer = STARTUP_RESET_TIMEOUT_MS;
+    break;
+  case STARTUP_Lost:
+    SunKbd_SendCommand(SUNKBD_CMD_RESET);
+    StartupTimer = SUNKBD_PROBE_MS;
+    break;
+  default:
+    SunKbd_SendCommand(SUNKBD_CMD_LAYOUT);
+    StartupTimer = STARTUP_LAYOUT_TIMEOUT_MS;
+    break;
+  }
+}
+
+static void Startup_Enter(uint8_t state, uint8_t retries)
+{
+  StartupState = state;
+  StartupRetries = retries;
+  Startup_Send();
+}
+
+static void Startup_Done(void)
+{
+  StartupState = STARTUP_Idle;
+  StartupTimer = 0;
+  LineQuiet = 0;
+  Tx_SendSettings();
+}
+
+static void Startup_Lost(void)
+{
+  if (StartupState == STARTUP_Lost) return;
+
+  Keys_ReleaseAll();
+  if (ReportDirty) {
+    Report_Enqueue(0, false);
+  }
+  KeyboardLayout = KeyboardType = 0xFF;
+  KeyMap_Select(KeyboardLayout);
+  KeyboardLosses++;
+
+  Startup_Enter(STARTUP_Lost, 0);
+}
+
+/** Reset the keyboard and find out its layout. LED and click settings made meanwhile are sent
+ *  once that is done.
+ */
+void SunKbd_Start(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TxPending = 0;
+  }
+  KeyboardType = 0xFF;
+  Startup_Enter(STARTUP_Reset, STARTUP_RETRIES);
+}
+
+static void Startup_MillisecondElapsed(void)
+{
+  if (LineQuiet < 0xFFFF) LineQuiet++;
+
+  if (StartupTimer == 0) {
+    if ((StartupState == STARTUP_Idle) && (KeyboardType == SUNKBD_TYPE_4) &&
+        (LineQuiet >= SUNKBD_PROBE_MS)) {
+      Startup_Enter(STARTUP_Probe, 1);
+    }
+    return;
+  }
+  if (--StartupTimer != 0) return;
+
+  if (StartupRetries > 0) {
+    StartupRetries--;
+    Startup_Send();
+    return;
+  }
+  switch (StartupState) {
+  case STARTUP_Reset:
+    Startup_Enter(STARTUP_Layout, STARTUP_RETRIES); // It may be running already.
+    break;
+  case STARTUP_Layout:
+    if (KeyboardType == 0xFF) {
+      Startup_Lost();           // Nothing answered at all.
+    }
+    else {
+      Startup_Done();           // Layout stays unknown.
+    }
+    break;
+  case STARTUP_Probe:
+    Startup_Lost();
+    break;
+  case STARTUP_Lost:
+    Startup_Send();             // Try again.
+    break;
+  }
+}
+
+static void Startup_ResetResponse(uint8_t type)
+{
+  KeyboardType = type;
+  if (type == SUNKBD_TYPE_4) {
+    Startup_Enter(STARTUP_Layout, STARTUP_RETRIES);
+  }
+  else {
+    Startup_Done();
+  }
+}
+
+static void Startup_LayoutResponse(void)
+{
+  if (StartupState == STARTUP_Layout) {
+    Startup_Done();
+  }
+  else if (StartupState == STARTUP_Probe) {
+    StartupState = STARTUP_Idle; // Still there.
+    StartupTimer = 0;
+  }
+}
+
+/*** Host Tables ***/
+
+// The host uploads a table into its staging buffer a piece at a time,
+// and then swaps it in whole, so that no key is ever translated, and no
+// macro played, with half of each. Keys down are released as what they
+// were pressed as; see Report State. A macro playing is stopped when
+// the macro table is swapped. The swap is refused until every piece has
+// been loaded, and while a table is being written to EEPROM; the host
+// can read the table back to see that it took.
+
+#if (REMAP_KEYS / TABLE_PIECE_SIZE > 8) || (SUNKBD_MACRO_BYTES / TABLE_PIECE_SIZE > 8)
+#error TABLE_PIECE_SIZE is too small to track the pieces in a byte
+#endif
+
+#if (SUNKBD_MACRO_BYTES % TABLE_PIECE_SIZE) != 0
+#error SUNKBD_MACRO_BYTES must be a multiple of TABLE_PIECE_SIZE
+#endif
+
+/** Start uploading the given table, all zero. */
+void Table_Begin(uint8_t table)
+{
+  if (table >= TABLE_Count) return;
+  memset(Tables[table].Staging, 0, Tables[table].Size);
+  Tables[table].Loaded = 0;
+}
+
+/** Load TABLE_PIECE_SIZE bytes of the table being uploaded, at the given offset, which must
+ *  be a multiple of that.
+ */
+void Table_Load(uint8_t table, uint8_t offset, const uint8_t* piece)
+{
+  Table_t* t;
+
+  if (table >= TABLE_Count) return;
+  t = &Tables[table];
+  if ((offset >= t->Size) || (offset % TABLE_PIECE_SIZE) != 0) return;
+  memcpy(t->Staging + offset, piece, TABLE_PIECE_SIZE);
+  t->Loaded |= 1 << (offset / TABLE_PIECE_SIZE);
+}
+
+/** Put the uploaded table in use and save it. Returns false if it was refused. */
+bool Table_Swap(uint8_t table)
+{
+  Table_t* t;
+  uint8_t* buffer;
+
+  if (table >= TABLE_Count) return false;
+  t = &Tables[table];
+  if ((t->Loaded != (uint8_t)((1 << (t->Size / TABLE_PIECE_SIZE)) - 1)) || Config_Writing()) {
+    return false;
+  }
+
+  if (table == TABLE_Macros) {
+    MacroRequested = 0;
+    Macro_Stop();
+  }
+  buffer = t->InUse;
+  t->InUse = t->Staging;
+  t->Staging = buffer;
+  t->Loaded = 0;
+  t->Dirty = true;
+  if (table == TABLE_Remap) KeyMap_Resolve();
+  Config_Changed();
+  return true;
+}
+
+/** Copy TABLE_PIECE_SIZE bytes of the given table in use, from the given offset. */
+void Table_Read(uint8_t table, uint8_t offset, uint8_t* piece)
+{
+  if ((table >= TABLE_Count) || (offset >= Tables[table].Size) ||
+      (offset % TABLE_PIECE_SIZE) != 0) {
+    memset(piece, 0, TABLE_PIECE_SIZE);
+    return;
+  }
+  memcpy(piece, Tables[table].InUse + offset, TABLE_PIECE_SIZE);
+}
+
+/*** Protocol Parser ***/
+
+// Each byte from the keyboard is sorted into a class with a few
+// compares, and the class and the parser state pick an action and the
+// next state from a table. A byte received with a framing error or
+// after an overrun cannot be trusted, so it is quarantined rather than
+// taken as a key: a corrupted release could leave a key stuck down, and
+// a corrupted press could make one up. Instead, the keys down at the
+// time are held in doubt until the next ALLUP, which the keyboard sends
+// when the last key comes up and which says exactly what is down. A
+// press of a key already down is taken the same way, as it means its
+// release went missing. If the ALLUP does not come soon, the held keys
+// are released and the keyboard is reset. Only a key that was down
+// when the error happened can be stuck, so once each of those has come
+// up the doubt is over, and a key held for a long time otherwise is
+// left alone, since the keyboard sends nothing while it is.
+
+#ifndef SUNKBD_RESYNC_MS
+#define SUNKBD_RESYNC_MS          2000
+#endif
+
+enum ParseStates_t
+{
+  PARSE_Key,                    // Key codes.
+  PARSE_Type,                   // Keyboard type after a reset response.
+  PARSE_Layout,                 // Layout byte after a layout response.
+  PARSE_NStates,
+};
+
+enum ParseClasses_t
+{
+  BYTE_Press,
+  BYTE_Release,
+  BYTE_AllUp,
+  BYTE_Reset,
+  BYTE_Layout,
+  BYTE_Error,                   // Self test failed.
+  BYTE_Bad,                     // Line error.
+  BYTE_NClasses,
+};
+
+enum ParseActions_t
+{
+  PARSE_Ignore,
+  PARSE_Press,
+  PARSE_Release,
+  PARSE_AllUp,
+  PARSE_Reset,
+  PARSE_TypeByte,
+  PARSE_LayoutByte,
+  PARSE_Quarantine,
+  PARSE_RequestReset,
+};
+
+#define PARSE_ENTRY(action, next) (((next) << 4) | (action))
+
+static const uint8_t ParseTable[PARSE_NStates][BYTE_NClasses] PROGMEM = {
+  [PARSE_Key] = {
+    [BYTE_Press]   = PARSE_ENTRY(PARSE_Press, PARSE_Key),
+    [BYTE_Release] = PARSE_ENTRY(PARSE_Release, PARSE_Key),
+    [BYTE_AllUp]   = PARSE_ENTRY(PARSE_AllUp, PARSE_Key),
+    [BYTE_Reset]   = PARSE_ENTRY(PARSE_Reset, PARSE_Type),
+    [BYTE_Layout]  = PARSE_ENTRY(PARSE_Ignore, PARSE_Layout),
+    [BYTE_Error]   = PARSE_ENTRY(PARSE_Quarantine, PARSE_Key),
+    [BYTE_Bad]     = PARSE_ENTRY(PARSE_Quarantine, PARSE_Key),
+  },
+  [PARSE_Type] = {
+    [BYTE_Press]   = PARSE_ENTRY(PARSE_TypeByte, PARSE_Key),
+    [BYTE_Release] = PARSE_ENTRY(PARSE_TypeByte, PARSE_Key),
+    [BYTE_AllUp]   = PARSE_ENTRY(PARSE_TypeByte, PARSE_Key),
+    [BYTE_Reset]   = PARSE_ENTRY(PARSE_TypeByte, PARSE_Key),
+    [BYTE_Layout]  = PARSE_ENTRY(PARSE_TypeByte, PARSE_Key),
+    [BYTE_Error]   = PARSE_ENTRY(PARSE_TypeByte, PARSE_Key),
+    [BYTE_Bad]     = PARSE_ENTRY(PARSE_RequestReset, PARSE_Key), // Nobody else will ask again.
+  },
+  [PARSE_Layout] = {
+    [BYTE_Press]   = PARSE_ENTRY(PARSE_LayoutByte, PARSE_Key),
+    [BYTE_Release] = PARSE_ENTRY(PARSE_LayoutByte, PARSE_Key),
+    [BYTE_AllUp]   = PARSE_ENTRY(PARSE_LayoutByte, PARSE_Key),
+    [BYTE_Reset]   = PARSE_ENTRY(PARSE_LayoutByte, PARSE_Key),
+    [BYTE_Layout]  = PARSE_ENTRY(PARSE_LayoutByte, PARSE_Key),
+    [BYTE_Error]   = PARSE_ENTRY(PARSE_LayoutByte, PARSE_Key),
+    [BYTE_Bad]     = PARSE_ENTRY(PARSE_Quarantine, PARSE_Key), // The query is retried.
+  },
+};
+
+static uint8_t ParseState;
+static uint16_t ResyncTimer;    // Nonzero while the key state is in doubt.
+static uint8_t KeysInDoubt;     // The oldest keys down, down at the error.
+
+static uint8_t Parse_Class(uint8_t key)
+{
+  if (key < SUNKBD_RET_ERROR) return BYTE_Press;
+  if (key == SUNKBD_RET_ERROR) return BYTE_Error;
+  if (key == SUNKBD_RET_ALLUP) return BYTE_AllUp;
+  if (key < SUNKBD_RET_LAYOUT) return BYTE_Release;
+  if (key == SUNKBD_RET_LAYOUT) return BYTE_Layout;
+  return BYTE_Reset;
+}
+
+static void Parse_Init(void)
+{
+  ParseState = PARSE_Key;
+  ResyncTimer = 0;
+}
+
+/** Note that a key byte may have been lost, so that what is down is in doubt. */
+static void Parse_Doubt(void)
+{
+  KeysInDoubt = NKeysDown;
+  if (NKeysDown > 0) ResyncTimer = SUNKBD_RESYNC_MS;
+}
+
+static void Parse_Byte(uint8_t class, uint8_t key, uint16_t time)
+{
+  uint8_t entry;
+
+  entry = pgm_read_byte(&ParseTable[ParseState][class]);
+  ParseState = entry >> 4;
+
+  switch (entry & 0x0F) {
+  case PARSE_Press:
+    if (KeyState_IsDown(key)) {
+      RepeatedPresses++;        // Its release was lost.
+      Parse_Doubt();
+    }
+    else if (NKeysDown == KEYS_DOWN_MAX) {
+      PressesDropped++;
+    }
+    else {
+      KeyState_Press(key);
+      Report_AddKey(key);
+    }
+    break;
+  case PARSE_Release:
+    key &= SUNKBD_KEY;
+    if (KeyState_IsDown(key)) {
+      if ((ResyncTimer != 0) && (KeyState_Index(key) < KeysInDoubt) && (--KeysInDoubt == 0)) {
+        ResyncTimer = 0;        // Every key down at the error has come up.
+      }
+      Report_RemoveKey(key, KeyState_Release(key), time);
+    }
+    else {
+      UnmatchedReleases++;      // Its press was lost.
+    }
+    break;
+  case PARSE_AllUp:
+    Keys_AllUp();
+    ResyncTimer = 0;
+    break;
+  case PARSE_Reset:
+    Keys_ReleaseAll();          // Plugged in again, or reset itself.
+    ResyncTimer = 0;
+    break;
+  case PARSE_TypeByte:
+    Startup_ResetResponse(key);
+    break;
+  case PARSE_LayoutByte:
+    KeyboardLayout = key;
+    KeyMap_Select(KeyboardLayout);
+    Startup_LayoutResponse();
+    break;
+  case PARSE_Quarantine:
+    BytesQuarantined++;
+    Parse_Doubt();
+    break;
+  case PARSE_RequestReset:
+    BytesQuarantined++;
+    Startup_Enter(STARTUP_Reset, STARTUP_RETRIES);
+    break;
+  }
+
+  if (ReportDirty) {
+    Report_Enqueue(time, true);
+  }
+}
+
+static void Parse_MillisecondElapsed(void)
+{
+  if ((ResyncTimer == 0) || (--ResyncTimer != 0)) return;
+
+  // No ALLUP came: nothing down can be trusted.
+  if (NKeysDown > 0) {
+    Keys_ReleaseAll();
+    Report_Enqueue(0, false);
+    if (StartupState != STARTUP_Reset) {
+      Startup_Enter(STARTUP_Reset, STARTUP_RETRIES);
+    }
+  }
+}
+
+/*** Counters ***/
+
+// Health counters, so that a keystroke lost on the way can be told
+// apart from one lost by the host. They wrap rather than stick.
+
+uint16_t RepeatedPresses;
+uint16_t PressesDropped;
+uint16_t UnmatchedReleases;
+uint16_t RolloverEvents;
+uint16_t ReportsSuppressed;
+uint32_t ReportsSent;
+uint16_t KeyboardLosses;
+uint16_t BytesQuarantined;
+
+void Stats_Clear(void)
+{
+  RepeatedPresses = UnmatchedReleases = 0;
+  PressesDropped = 0;
+  RolloverEvents = 0;
+  ReportsSuppressed = 0;
+  ReportsSent = 0;
+  KeyboardLosses = 0;
+  BytesQuarantined = 0;
+  ReportQueueOverflows = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TxQueued = TxCoalesced = 0;
+  }
+}
+
+/*** Keyboard Interface ***/
+
+void SunKbd_InitState(void)
+{
+  KeyState_Clear();
+  LayerToggled = 0;
+  Report_Clear();
+  ReportDirty = false;
+  ReportQueueCount = 0;
+  memset(ReportQueue, 0, sizeof(ReportQueue)); // The host starts with nothing down.
+  ReportQueueStale = false;
+  DequeuedUnsent = false;
+  Latency_Clear();
+  Stats_Clear();
+
+  KeyboardLayout = 0xFF;
+  KeyboardType = 0xFF;
+  KeyMap_Select(KeyboardLayout);
+  Parse_Init();
+
+  TxHead = TxTail = 0;
+  TxPending = 0;
+  TxBlank = false;
+
+  HostSuspended = false;
+  ConsumerControls = 0;
+  SystemUsage = SystemKey = SystemLine = 0;
+  ControlQueueCount = 0;
+
+  StartupState = STARTUP_Idle;
+  StartupTimer = 0;
+  LineQuiet = 0;
+
+  ConfigTimer = 0;
+  ConfigWriteIndex = ConfigWriteSize = 0;
+}
+
+/** Handle a byte from the keyboard, which arrived at the given timer tick. */
+void SunKbd_ProcessByte(uint8_t key, uint16_t time)
+{
+  LineQuiet = 0;
+  Parse_Byte(Parse_Class(key), key, time);
+}
+
+/** Called instead of SunKbd_ProcessByte() for a byte received with a line error, a combination
+ *  of SUNKBD_LINE_* flags. A break, which reads as all zero with a framing error, means that
+ *  the keyboard has been unplugged.
+ */
+void SunKbd_LineError(uint8_t data, uint8_t errors)
+{
+  if ((errors & SUNKBD_LINE_FRAMING) && (data == 0)) {
+    Parse_Init();
+    Startup_Lost();
+    return;
+  }
+  LineQuiet = 0;
+  Parse_Byte(BYTE_Bad, data, 0);
+}
+
+/** Called every millisecond, for the startup and resynchronization timeouts, for dual-role
+ *  keys, for playing macros and for writing settings.
+ */
+void SunKbd_MillisecondElapsed(void)
+{
+  Parse_MillisecondElapsed();
+  Startup_MillisecondElapsed();
+  Tap_MillisecondElapsed();
+  Macro_MillisecondElapsed();
+  Config_MillisecondElapsed();
+}
+
+/** Note that the Power key line has gone down or come up. */
+void SunKbd_PowerKey(bool pressed)
+{
+  Control_System(&SystemLine, SYSTEM_CONTROL_POWER_DOWN, BootReport.Modifier, pressed);
+}
+
+/** Note the protocol selected by the host. Returns true if it changed, in which case queued
+ *  reports, which are in the old format, are dropped.
+ */
+bool Report_SetProtocol(bool ReportProtocol)
+{
+  if (ReportProtocol == UsingReportProtocol) return false;
+  UsingReportProtocol = ReportProtocol;
+  KeyMap_Resolve();
+  ReportQueueCount = 0;
+  ReportQueueStale = true;
+  ControlQueueCount = 0;
+  return true;
+}
+
+/** Number of report changes waiting to be sent. */
+uint8_t Report_Pending(void)
+{
+  return ReportQueueCount;
+}
+
+/** Fill in the next report for the host. If Dequeue is set and there is a queued change, that
+ *  is taken off the queue and true is returned. Otherwise the current state is given.
+ */
+bool Report_Create(void* ReportData, uint16_t* const ReportSize, bool Dequeue)
+{
+  if (Dequeue && (ReportQueueCount > 0)) {
+    *ReportSize = (UsingReportProtocol && KEYBOARD_NKRO) ?
+      sizeof(USB_NKROKeyboardReport_Data_t) : sizeof(USB_KeyboardReport_Data_t);
+    memcpy(ReportData, &ReportQueue[ReportQueueHead], *ReportSize);
+    DequeuedTime = ReportQueueTime[ReportQueueHead];
+    DequeuedTimed = ReportQueueTimed[ReportQueueHead];
+    DequeuedUnsent = true;
+    ReportQueueHead = (ReportQueueHead + 1) & REPORT_QUEUE_MASK;
+    ReportQueueCount--;
+    return true;
+  }
+  *ReportSize = Report_Copy(ReportData);
+  return false;
+}
+
+/** Note that the report last taken off the queue has gone to the endpoint at the given timer
+ *  tick, and record how long its change took.
+ */
+void Report_Sent(uint16_t now)
+{
+  if (!DequeuedUnsent) return;
+  DequeuedUnsent = false;
+  ReportsSent++;
+  if (DequeuedTimed) {
+    Latency_Record(now - DequeuedTime);
+  }
+}
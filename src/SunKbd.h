@@ -0,0 +1,281 @@
+/* 
+  Copyright 2015 Mike McMahon
+
+  LUFA Library
+  Copyright 2014  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Header file for SunKbd.c.
+ */
+
+#ifndef _SUNKBD_H_
+#define _SUNKBD_H_
+
+/* Includes: */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+
+/* Macros: */
+/** Nonzero to send keys as a bitmap in report protocol (N-key rollover), zero for the six-key array. */
+#ifndef KEYBOARD_NKRO
+#define KEYBOARD_NKRO           1
+#endif
+
+/** Number of keyboard page usages covered by the NKRO bitmap, everything below the modifiers. */
+#define KEYBOARD_NKRO_USAGES    0xE0
+
+// Taken from Linux kernel drivers/input/keyboard/sunkbd.c
+
+#define SUNKBD_CMD_RESET        0x1
+#define SUNKBD_CMD_BELLON       0x2
+#define SUNKBD_CMD_BELLOFF      0x3
+#define SUNKBD_CMD_CLICK        0xa
+#define SUNKBD_CMD_NOCLICK      0xb
+#define SUNKBD_CMD_SETLED       0xe
+#define SUNKBD_CMD_LAYOUT       0xf
+
+#define SUNKBD_RET_RESET        0xff
+#define SUNKBD_RET_ALLUP        0x7f
+#define SUNKBD_RET_ERROR        0x7e
+#define SUNKBD_RET_LAYOUT       0xfe
+
+#define SUNKBD_LAYOUT_5_MASK    0x20
+#define SUNKBD_RELEASE          0x80
+#define SUNKBD_KEY              0x7f
+
+/** Keymap entries past the modifiers, for keys sent in the control reports: a bit in the
+ *  Consumer report, or a System Control usage from SYSTEM_CONTROL_POWER_DOWN on. Between
+ *  them are the layer keys, active while held or toggled, for layers 1 to LAYERS_MAX.
+ */
+#define KEYMAP_CONSUMER_FIRST     0xE8
+#define KEYMAP_LAYER_FIRST        0xF4
+#define KEYMAP_TOGGLE_FIRST       0xF8
+#define KEYMAP_SYSTEM_FIRST       0xFC
+#define LAYERS_MAX                4
+
+/** Keymap entries in the keyboard page's reserved usages, for keys that play a macro. */
+#define KEYMAP_MACRO_FIRST        0xA5
+#define KEYMAP_MACRO_COUNT        11
+
+/** Generic Desktop System Control usages sent for the Power key. */
+#define SYSTEM_CONTROL_POWER_DOWN 0x81
+#define SYSTEM_CONTROL_SLEEP      0x82
+#define SYSTEM_CONTROL_WAKE_UP    0x83
+
+/** Line errors for SunKbd_LineError(). */
+#define SUNKBD_LINE_FRAMING     0x01
+#define SUNKBD_LINE_OVERRUN     0x02
+
+/** Number of EEPROM slots that settings records take in turn. */
+#ifndef SUNKBD_CONFIG_SLOTS
+#define SUNKBD_CONFIG_SLOTS     8
+#endif
+
+/** Version of Config_Data_t. A record of any other version is ignored. */
+#define CONFIG_VERSION          4
+
+/** Entries in the key remap table, one per Sun scancode. */
+#define REMAP_KEYS              (SUNKBD_KEY + 1)
+
+/** Bytes in the macro table. */
+#ifndef SUNKBD_MACRO_BYTES
+#define SUNKBD_MACRO_BYTES      128
+#endif
+
+/** Bytes of a table in each piece uploaded or read back. */
+#define TABLE_PIECE_SIZE        16
+
+/** Steps in the macro table. Each macro is a list of them, ending with MACRO_END; every
+ *  other step is followed by one byte.
+ */
+#define MACRO_END               0x00 /**< End of the macro */
+#define MACRO_PRESS             0x01 /**< Press the keymap code that follows */
+#define MACRO_RELEASE           0x02 /**< Release the keymap code that follows */
+#define MACRO_TAP               0x03 /**< Press the keymap code that follows, and release it next */
+#define MACRO_WAIT              0x04 /**< Wait the milliseconds that follow */
+
+/* Type Defines: */
+typedef uint8_t HidUsageID;
+
+/** Type define for the report protocol N-key rollover keyboard report. */
+typedef struct
+{
+  uint8_t Modifier; /**< Keyboard modifier byte, indicating pressed modifier keys (a combination of HID_KEYBOARD_MODIFER_* masks) */
+  uint8_t KeyBitmap[KEYBOARD_NKRO_USAGES / 8]; /**< One bit per key usage, set when that key is pressed */
+} ATTR_PACKED USB_NKROKeyboardReport_Data_t;
+
+/** Number of buckets in the latency histogram. */
+#define LATENCY_BUCKETS         16
+
+/** Latency histogram, from a keyboard byte arriving to the report carrying its change going to
+ *  the endpoint, in ticks of the hardware layer's timer. Bucket 0 counts latencies under one
+ *  tick, bucket n those from 2^(n-1) up to 2^n ticks, and the last bucket everything longer.
+ */
+typedef struct
+{
+  uint16_t Min; /**< Shortest latency, or 0xFFFF if none yet */
+  uint16_t Max; /**< Longest latency */
+  uint16_t Buckets[LATENCY_BUCKETS]; /**< Count of latencies in each bucket, stopping at 0xFFFF */
+} ATTR_PACKED Latency_Data_t;
+
+/** Enum for the tables uploaded from the host and kept in EEPROM. */
+enum Tables_t
+{
+  TABLE_Remap  = 0, /**< Key remap table, a keymap code per Sun scancode */
+  TABLE_Macros = 1, /**< Macro steps */
+  TABLE_Count
+};
+
+/** Largest keyboard report, in either protocol. */
+typedef union
+{
+  USB_KeyboardReport_Data_t     Boot;
+  USB_NKROKeyboardReport_Data_t NKRO;
+} KeyboardReportBuffer_t;
+
+/** Enum for the control reports, sent apart from the keyboard report. */
+enum ControlReports_t
+{
+  CONTROL_REPORT_System   = 1, /**< System Control report */
+  CONTROL_REPORT_Consumer = 2, /**< Consumer report */
+};
+
+/** Type define for the Consumer report, a bitmap of the controls in Layouts.h. */
+typedef struct
+{
+  uint16_t Controls; /**< One bit per Consumer page usage, set when that key is pressed */
+} ATTR_PACKED USB_ConsumerReport_Data_t;
+
+/** Type define for the System Control report, which has the one control that is down, or 0. */
+typedef struct
+{
+  uint8_t Usage; /**< Generic Desktop usage of the control, one of the SYSTEM_CONTROL_* values */
+} ATTR_PACKED USB_SystemControlReport_Data_t;
+
+/** Settings kept in EEPROM. All zero is the default. */
+typedef struct
+{
+  uint8_t Click;           /**< Nonzero for keyclick */
+  uint8_t PollingInterval; /**< Endpoint polling interval in milliseconds, 0 for the default */
+  uint8_t Banks;           /**< Bit per TABLE_*, for which of its two EEPROM banks has it */
+  uint8_t TapTime;         /**< Milliseconds a dual-role key can be down and still be a tap, 0 for the default */
+} ATTR_PACKED Config_Data_t;
+
+/** Settings record, as written to each EEPROM slot. */
+typedef struct
+{
+  uint8_t       Sequence;  /**< One more than the record written before it */
+  uint8_t       Version;   /**< CONFIG_VERSION */
+  Config_Data_t Data;      /**< The settings */
+  uint16_t      CRC;       /**< CRC-CCITT of everything before it */
+} ATTR_PACKED Config_Record_t;
+
+/** EEPROM bytes for the settings records and two banks for each table, each with a CRC. */
+#define CONFIG_EEPROM_SIZE      (SUNKBD_CONFIG_SLOTS * sizeof(Config_Record_t) + \
+                                 2 * (REMAP_KEYS + sizeof(uint16_t)) + \
+                                 2 * (SUNKBD_MACRO_BYTES + sizeof(uint16_t)))
+
+/* External Variables: */
+/** Layout byte reported by the keyboard, or 0xFF if not known yet. */
+extern uint8_t KeyboardLayout;
+/** Keyboard type from its reset response, or 0xFF if not known yet. */
+extern uint8_t KeyboardType;
+/** Number of keys down. */
+extern uint8_t NKeysDown;
+/** Count of report changes merged into an earlier one because the queue was full. */
+extern uint16_t ReportQueueOverflows;
+/** Count of commands queued for the keyboard. */
+extern volatile uint16_t TxQueued;
+/** Count of LED or click settings replaced before being sent, or one-shot commands dropped for a full queue. */
+extern volatile uint16_t TxCoalesced;
+/** Keystroke latency histogram. */
+extern Latency_Data_t Latency;
+/** Count of presses for keys already down, meaning that a release was lost. */
+extern uint16_t RepeatedPresses;
+/** Count of presses dropped because KEYS_DOWN_MAX keys were already down. */
+extern uint16_t PressesDropped;
+/** Count of releases for keys not down, meaning that a press was lost. */
+extern uint16_t UnmatchedReleases;
+/** Count of times the six-key array rolled over. */
+extern uint16_t RolloverEvents;
+/** Count of key bytes that left the report unchanged, so that nothing was queued. */
+extern uint16_t ReportsSuppressed;
+/** Count of queued reports sent to the host. */
+extern uint32_t ReportsSent;
+/** Count of times the keyboard was unplugged or stopped answering. */
+extern uint16_t KeyboardLosses;
+/** Count of bytes from the keyboard ignored because they could not be trusted. */
+extern uint16_t BytesQuarantined;
+/** Settings, as loaded by Config_Load(). Call Config_Changed() after changing them. */
+extern Config_Data_t Config;
+
+/* Function Prototypes: */
+void SunKbd_InitState(void);
+void SunKbd_ProcessByte(uint8_t key, uint16_t time);
+void SunKbd_Start(void);
+void SunKbd_MillisecondElapsed(void);
+void SunKbd_LineError(uint8_t data, uint8_t errors);
+
+void SunKbd_SendCommand(uint8_t cmd);
+void SunKbd_SetLEDs(uint8_t LEDMask);
+void SunKbd_SetClick(bool enabled);
+void SunKbd_Suspend(bool suspended);
+void SunKbd_PowerKey(bool pressed);
+int16_t SunKbd_NextCommandByte(void);
+int16_t SunKbd_NextConfigByte(uint16_t* offset);
+
+/** Supplied by the hardware layer: start calling SunKbd_NextCommandByte() until it returns -1. */
+void SunKbd_StartTransmit(void);
+/** Supplied by the hardware layer: read a byte of the settings records in EEPROM. */
+uint8_t SunKbd_ReadConfig(uint16_t offset);
+/** Supplied by the hardware layer: start calling SunKbd_NextConfigByte() until it returns -1. */
+void SunKbd_StartConfigWrite(void);
+
+bool Report_SetProtocol(bool UsingReportProtocol);
+bool Report_Create(void* ReportData, uint16_t* const ReportSize, bool Dequeue);
+uint8_t Report_Pending(void);
+void Report_Sent(uint16_t now);
+
+uint8_t Control_Pending(void);
+uint8_t Control_Create(uint8_t report, void* ReportData, uint16_t* const ReportSize, bool Dequeue);
+
+void Config_Load(void);
+void Config_Changed(void);
+
+void Table_Begin(uint8_t table);
+void Table_Load(uint8_t table, uint8_t offset, const uint8_t* piece);
+bool Table_Swap(uint8_t table);
+void Table_Read(uint8_t table, uint8_t offset, uint8_t* piece);
+
+void Latency_Clear(void);
+void Stats_Clear(void);
+
+#endif
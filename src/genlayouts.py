@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+#
+# Generate the keymaps, layers, tap usages, layout selection and control
+# report usages for the firmware, and the layout names for sunkbd-mode, from
+# layouts.txt.
+#
+# Usage: genlayouts.py layouts.txt Layouts.h ../utils/layouts.h
+
+import re
+import sys
+
+NKEYS = 128
+MAX_CONSUMER = 12
+SYSTEM_FIRST, SYSTEM_LAST = 0x81, 0x84
+SYSTEM_INDEX = 0xFC - 0xE8              # KEYMAP_SYSTEM_FIRST - KEYMAP_CONSUMER_FIRST
+MAX_LAYERS = 4
+
+
+class Family:
+    def __init__(self, mask, value, name):
+        self.mask = mask
+        self.value = value
+        self.name = name
+        self.ident = 'KeyMap_' + re.sub(r'\W', '', name)
+        self.keys = {}
+        self.layouts = []
+
+
+def fail(path, lineno, message):
+    sys.exit('%s:%d: %s' % (path, lineno, message))
+
+
+def parse(path):
+    base = {}
+    families = []
+    layers = []
+    taps = {}
+    controls = {}
+    consumer = []
+    boot = []
+    for n in range(1, MAX_LAYERS + 1):
+        controls['LAYER%d' % n] = 'KEYMAP_LAYER_FIRST + %d' % (n - 1)
+        controls['TOGGLE%d' % n] = 'KEYMAP_TOGGLE_FIRST + %d' % (n - 1)
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            comment = None
+            if '#' in line:
+                line, comment = line.split('#', 1)
+                comment = comment.strip()
+            words = line.split()
+            if not words:
+                continue
+            try:
+                if words[0] == 'key' and len(words) == 3:
+                    code = int(words[1], 16)
+                    if code >= NKEYS:
+                        fail(path, lineno, 'scancode out of range')
+                    if families:
+                        keys = families[-1].keys
+                    elif layers:
+                        keys = layers[-1]
+                    else:
+                        keys = base
+                    if words[2] == '-':
+                        if layers and not families:
+                            fail(path, lineno, 'a layer key cannot be -')
+                        keys[code] = ('0', comment)
+                    elif words[2] in controls:
+                        keys[code] = (controls[words[2]], comment or words[2])
+                    else:
+                        keys[code] = ('HID_KEYBOARD_SC_' + words[2], comment)
+                elif words[0] == 'tap' and len(words) == 3 and not families:
+                    code = int(words[1], 16)
+                    if code >= NKEYS:
+                        fail(path, lineno, 'scancode out of range')
+                    if words[2] in controls:
+                        taps[code] = (controls[words[2]], comment or words[2])
+                    else:
+                        taps[code] = ('HID_KEYBOARD_SC_' + words[2], comment)
+                elif words[0] == 'layer' and len(words) == 2 and not families:
+                    if int(words[1]) != len(layers) + 1 or len(layers) == MAX_LAYERS:
+                        fail(path, lineno, 'layers go from 1 to %d in order' % MAX_LAYERS)
+                    layers.append({})
+                elif words[0] == 'consumer' and len(words) in (3, 4) and not families:
+                    if len(consumer) == MAX_CONSUMER:
+                        fail(path, lineno, 'more than %d consumer controls' % MAX_CONSUMER)
+                    controls[words[1]] = 'KEYMAP_CONSUMER_FIRST + %d' % len(consumer)
+                    consumer.append((int(words[2], 16), words[1]))
+                    if len(words) == 4:
+                        boot.append((len(consumer) - 1, words[3], words[1]))
+                elif words[0] == 'system' and len(words) in (3, 4) and not families:
+                    usage = int(words[2], 16)
+                    if not SYSTEM_FIRST <= usage <= SYSTEM_LAST:
+                        fail(path, lineno, 'system control out of range')
+                    controls[words[1]] = 'KEYMAP_SYSTEM_FIRST + %d' % (usage - SYSTEM_FIRST)
+                    if len(words) == 4:
+                        boot.append((SYSTEM_INDEX + usage - SYSTEM_FIRST, words[3], words[1]))
+                elif words[0] == 'family' and len(words) >= 4:
+                    families.append(Family(int(words[1], 16), int(words[2], 16),
+                                           ' '.join(words[3:])))
+                elif words[0] == 'layout' and len(words) >= 3 and families:
+                    family = families[-1]
+                    byte = int(words[1], 16)
+                    if (byte & family.mask) != family.value:
+                        fail(path, lineno, 'layout %02X is not in family %s' % (byte, family.name))
+                    family.layouts.append((byte, ' '.join(words[2:])))
+                else:
+                    fail(path, lineno, 'bad line')
+            except ValueError:
+                fail(path, lineno, 'bad number')
+    if len(base) != NKEYS:
+        sys.exit('%s: shared keymap needs all %d scancodes' % (path, NKEYS))
+    if not families:
+        sys.exit('%s: no families' % path)
+    return base, families, layers, taps, consumer, boot
+
+
+HEADER = '/* Generated by genlayouts.py from layouts.txt; do not edit. */'
+
+
+def write_keymap(out, keys):
+    for code in range(NKEYS):
+        entry, comment = keys(code)
+        if code < NKEYS - 1:
+            entry += ','
+        if comment is None and code % 8 == 0:
+            comment = '0x%02X' % code
+        if comment is not None:
+            entry = '%-30s // %s' % (entry, comment)
+        out.append('  ' + entry)
+
+
+def layer_entry(layers, mask, code):
+    """The entry for a scancode from the highest layer in mask that gives it, or 0."""
+    for n in reversed(range(len(layers))):
+        if mask & (1 << n) and code in layers[n]:
+            return layers[n][code]
+    return ('0', None)
+
+
+def write_firmware(path, base, families, layers, taps, consumer, boot):
+    out = [HEADER]
+    out.append('')
+    out.append('/** Consumer page usages, one bit each in the Consumer report, in bit order. */')
+    out.append('#define CONSUMER_CONTROL_COUNT %d' % len(consumer))
+    out.append('#define CONSUMER_CONTROL_USAGES \\')
+    out.append(' \\\n'.join('  HID_RI_USAGE(16, 0x%04X), /* %s */' % (usage, name)
+                             for usage, name in consumer))
+    out.append('')
+    out.append('#ifndef LAYOUTS_CONTROLS_ONLY')
+    for family in families:
+        out.append('')
+        out.append('/** Keymap for %s keyboards, from Sun scancode to HID usage. */' % family.name)
+        out.append('static HidUsageID const %s[%d] PROGMEM = {' % (family.ident, NKEYS))
+        write_keymap(out, lambda code: family.keys.get(code, base[code]))
+        out.append('};')
+    out.append('')
+    out.append('/** Layers defined, each a bit in the active layer mask. */')
+    out.append('#define LAYER_COUNT %d' % len(layers))
+    if layers:
+        out.append('')
+        out.append('/** Keymap for each nonzero active layer mask, from Sun scancode to the HID usage of')
+        out.append(' *  the highest active layer that gives the key, or 0 for none.')
+        out.append(' */')
+        out.append('static HidUsageID const LayerMap[%d][%d] PROGMEM = {'
+                   % ((1 << len(layers)) - 1, NKEYS))
+        for mask in range(1, 1 << len(layers)):
+            out.append('  { /* %s */' % ' '.join('%d' % (n + 1) for n in range(len(layers))
+                                                if mask & (1 << n)))
+            write_keymap(out, lambda code: layer_entry(layers, mask, code))
+            out.append('  },')
+        out.append('};')
+    out.append('')
+    out.append('/** Dual-role keys, which send a usage of their own when tapped. */')
+    out.append('#define TAP_COUNT %d' % len(taps))
+    if taps:
+        out.append('')
+        out.append('/** Usage sent when each Sun scancode is tapped, or 0 if it is not a dual-role key. */')
+        out.append('static HidUsageID const TapMap[%d] PROGMEM = {' % NKEYS)
+        write_keymap(out, lambda code: taps.get(code, ('0', None)))
+        out.append('};')
+    out.append('')
+    out.append('/** Keyboard usage sent for each control to a boot protocol host, which has no control')
+    out.append(' *  reports, or 0 for none.')
+    out.append(' */')
+    out.append('static HidUsageID const ControlBootMap[0x100 - KEYMAP_CONSUMER_FIRST] PROGMEM = {')
+    for index, usage, name in boot:
+        out.append('  %-40s // %s' % ('[%d] = HID_KEYBOARD_SC_%s,' % (index, usage), name))
+    out.append('};')
+    out.append('')
+    out.append('/** Keymap for a layout byte. */')
+    out.append('static const HidUsageID* KeyMap_ForLayout(uint8_t layout)')
+    out.append('{')
+    for family in families[:-1]:
+        out.append('  if ((layout & 0x%02X) == 0x%02X) return %s;'
+                   % (family.mask, family.value, family.ident))
+    out.append('  return %s;' % families[-1].ident)
+    out.append('}')
+    out.append('#endif')
+    with open(path, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+def write_names(path, families):
+    out = [HEADER.replace('genlayouts.py from layouts.txt',
+                          'src/genlayouts.py from src/layouts.txt'), '']
+    out.append('static const struct {')
+    out.append('  unsigned char code;')
+    out.append('  const char *name;')
+    out.append('} layout_names[] = {')
+    for family in families:
+        for byte, name in family.layouts:
+            out.append('  { 0x%02X, "%s / %s" },' % (byte, family.name, name))
+    out.append('};')
+    with open(path, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit('Usage: %s layouts.txt Layouts.h ../utils/layouts.h' % sys.argv[0])
+    base, families, layers, taps, consumer, boot = parse(sys.argv[1])
+    write_firmware(sys.argv[2], base, families, layers, taps, consumer, boot)
+    write_names(sys.argv[3], families)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,546 @@
+/*
+ * Trace replay benchmark for the converter core. Replays synthetic Sun
+ * keyboard traces, and any recorded traces named on the command line,
+ * through SunKbd_ProcessByte() and Report_Create(), and reports
+ *
+ *  - host time per byte processed and per report created, and
+ *  - keyboard byte to host report latency, with the host polling
+ *    every 1 ms and every 5 ms.
+ *
+ * The converter's millisecond tick runs alongside. Reports it makes by
+ * itself, such as a dual-role key held past its tap time, are counted
+ * but not timed.
+ *
+ * Keyboard bytes are paced at the line rate: 10 bits at 1200 baud. The
+ * synthetic traces send ALLUP after the last key goes up, as a Sun
+ * keyboard does.
+ * Host times are only good for comparing one build of the core with
+ * another, not for cycle counts on the AVR.
+ *
+ * Recorded trace lines (# starts a comment):
+ *   MS XX ...   bytes from the keyboard, starting MS milliseconds in
+ *   MS leds XX  host sets the keyboard LEDs at MS milliseconds
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "SunKbd.h"
+
+#define BYTE_TIME_US 8333       /* 10 bits at 1200 baud */
+#define REPEATS 20
+
+enum { EV_KEY, EV_LEDS };
+
+struct event {
+  uint32_t time_us;
+  uint8_t kind, value;
+};
+
+struct trace {
+  const char *name;
+  struct event *events;
+  int n, size;
+  uint32_t line_free_us;        /* When the keyboard line is next free. */
+  uint8_t down[16];             /* Keys down, for synthetic traces. */
+  int ndown;
+  uint8_t remap[REMAP_KEYS];    /* Remap table uploaded before replaying. */
+};
+
+struct cost {
+  uint64_t total_ns, max_ns;
+  unsigned long count;
+};
+
+static uint64_t timer_overhead_ns;
+
+void SunKbd_StartTransmit(void)
+{
+}
+
+uint8_t SunKbd_ReadConfig(uint16_t offset)
+{
+  return 0xFF;
+}
+
+void SunKbd_StartConfigWrite(void)
+{
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void cost_add(struct cost *cost, uint64_t start, uint64_t end)
+{
+  uint64_t ns = end - start;
+  ns = (ns > timer_overhead_ns) ? ns - timer_overhead_ns : 0;
+  cost->total_ns += ns;
+  if (ns > cost->max_ns) cost->max_ns = ns;
+  cost->count++;
+}
+
+static void calibrate(void)
+{
+  uint64_t best = ~(uint64_t)0;
+  for (int i = 0; i < 10000; i++) {
+    uint64_t start = now_ns(), end = now_ns();
+    if (end - start < best) best = end - start;
+  }
+  timer_overhead_ns = best;
+}
+
+/*** Traces ***/
+
+static void add_event(struct trace *trace, uint32_t time_us, uint8_t kind, uint8_t value)
+{
+  if (trace->n == trace->size) {
+    trace->size = trace->size ? trace->size * 2 : 1024;
+    trace->events = realloc(trace->events, trace->size * sizeof(struct event));
+    if (trace->events == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  trace->events[trace->n].time_us = time_us;
+  trace->events[trace->n].kind = kind;
+  trace->events[trace->n].value = value;
+  trace->n++;
+}
+
+/* A keyboard byte, no earlier than the line allows. */
+static void add_byte(struct trace *trace, uint32_t time_us, uint8_t byte)
+{
+  if (time_us < trace->line_free_us) time_us = trace->line_free_us;
+  add_event(trace, time_us, EV_KEY, byte);
+  trace->line_free_us = time_us + BYTE_TIME_US;
+}
+
+/* A key press or release, followed by ALLUP when it was the last key
+   down, as the keyboard sends. */
+static void add_key(struct trace *trace, uint32_t time_us, uint8_t byte)
+{
+  uint8_t key = byte & ~SUNKBD_RELEASE, bit = 1 << (key & 7);
+
+  add_byte(trace, time_us, byte);
+  if (!(byte & SUNKBD_RELEASE)) {
+    if (!(trace->down[key >> 3] & bit)) trace->ndown++;
+    trace->down[key >> 3] |= bit;
+  }
+  else if (trace->down[key >> 3] & bit) {
+    trace->down[key >> 3] &= ~bit;
+    if (--trace->ndown == 0) add_byte(trace, time_us, SUNKBD_RET_ALLUP);
+  }
+}
+
+static int compare_events(const void *a, const void *b)
+{
+  const struct event *ea = a, *eb = b;
+  if (ea->time_us != eb->time_us) return (ea->time_us < eb->time_us) ? -1 : 1;
+  return (ea < eb) ? -1 : 1;
+}
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng(uint32_t n)
+{
+  rng_state = rng_state * 1103515245 + 12345;
+  return (rng_state >> 8) % n;
+}
+
+/* Sun scancodes for letters and space. */
+static const uint8_t TypingKeys[] = {
+  0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F, /* Q - P */
+  0x4D, 0x4E, 0x4F, 0x50, 0x51, 0x52, 0x53, 0x54, 0x55,       /* A - L */
+  0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A,                   /* Z - M */
+  0x79, 0x79, 0x79, 0x79                                      /* Space */
+};
+
+#define SUN_LEFT_SHIFT 0x63
+#define SUN_CAPS_LOCK 0x77      /* Remapped to Control: Escape when tapped. */
+
+/* Touch typing at about 80 words a minute, with rolled keys and shifts. */
+static void typing_trace(struct trace *trace, int keystrokes, bool led_storm)
+{
+  uint32_t t = 100000, end;
+  uint8_t prev = 0;
+  uint32_t prev_up = 0;
+
+  for (int i = 0; i < keystrokes; i++) {
+    uint8_t key = TypingKeys[rng(sizeof(TypingKeys))];
+    bool shifted = rng(100) < 10;
+
+    t += 60000 + rng(120000);
+    /* Often the previous key is still down: a roll. */
+    if (prev && prev_up <= t) {
+      add_key(trace, prev_up, prev | SUNKBD_RELEASE);
+      prev = 0;
+    }
+    if (shifted) add_key(trace, t - 30000, SUN_LEFT_SHIFT);
+    add_key(trace, t, key);
+    if (prev) add_key(trace, t + 20000, prev | SUNKBD_RELEASE);
+    if (shifted) {
+      add_key(trace, t + 60000, key | SUNKBD_RELEASE);
+      add_key(trace, t + 70000, SUN_LEFT_SHIFT | SUNKBD_RELEASE);
+      prev = 0;
+      t += 70000;
+    }
+    else {
+      prev = key;
+      prev_up = t + 70000 + rng(60000);
+    }
+  }
+  if (prev) add_key(trace, prev_up, prev | SUNKBD_RELEASE);
+
+  if (led_storm) {
+    /* Host flips Caps Lock every millisecond. */
+    end = trace->line_free_us;
+    for (t = 0; t < end; t += 1000) {
+      add_event(trace, t, EV_LEDS, ((t / 1000) & 1) ? 0x08 : 0x00);
+    }
+  }
+}
+
+/* Typing with Caps Lock as a dual-role key: held as Control for a
+   chord, tapped for Escape, or held alone past the tap time. */
+static void dual_role_trace(struct trace *trace, int keystrokes)
+{
+  uint32_t t = 100000;
+
+  for (int i = 0; i < keystrokes; i++) {
+    uint8_t key = TypingKeys[rng(sizeof(TypingKeys))];
+    uint32_t r = rng(100);
+
+    t += 60000 + rng(120000);
+    if (r < 20) {
+      add_key(trace, t - 40000 - rng(100000), SUN_CAPS_LOCK);
+      add_key(trace, t, key);
+      add_key(trace, t + 60000, key | SUNKBD_RELEASE);
+      add_key(trace, t + 80000 + rng(60000), SUN_CAPS_LOCK | SUNKBD_RELEASE);
+      t += 140000;
+    }
+    else if (r < 30) {
+      add_key(trace, t, SUN_CAPS_LOCK);
+      add_key(trace, t + 50000 + rng(100000), SUN_CAPS_LOCK | SUNKBD_RELEASE);
+      t += 150000;
+    }
+    else if (r < 32) {
+      add_key(trace, t, SUN_CAPS_LOCK);
+      add_key(trace, t + 300000, SUN_CAPS_LOCK | SUNKBD_RELEASE);
+      t += 300000;
+    }
+    else {
+      add_key(trace, t, key);
+      add_key(trace, t + 70000 + rng(60000), key | SUNKBD_RELEASE);
+    }
+  }
+}
+
+/* Sixteen keys down as fast as the line allows, then all released. */
+static void mash_trace(struct trace *trace, int rounds)
+{
+  uint32_t t = 100000;
+
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < 16; i++) add_key(trace, t, TypingKeys[i]);
+    t = trace->line_free_us + 200000;
+    for (int i = 0; i < 16; i++) add_key(trace, t, TypingKeys[i] | SUNKBD_RELEASE);
+    t = trace->line_free_us + 300000;
+  }
+}
+
+/* Keyboard resets and layout queries, with some typing in between. */
+static void reset_trace(struct trace *trace, int rounds)
+{
+  uint32_t t = 100000;
+
+  for (int r = 0; r < rounds; r++) {
+    add_byte(trace, t, SUNKBD_RET_RESET);
+    add_byte(trace, t, 0x04);
+    add_byte(trace, t, SUNKBD_RET_LAYOUT);
+    add_byte(trace, t, 0x21);
+    add_byte(trace, t, SUNKBD_RET_ALLUP);
+    for (int i = 0; i < 4; i++) {
+      add_key(trace, t + 50000, TypingKeys[i]);
+      add_key(trace, t + 100000, TypingKeys[i] | SUNKBD_RELEASE);
+      t += 100000;
+    }
+    t += 500000;
+  }
+}
+
+static bool load_trace(struct trace *trace, const char *path)
+{
+  FILE *f;
+  char line[1024];
+  int lineno = 0;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char *tok, *end;
+    uint32_t t;
+    bool leds = false;
+
+    lineno++;
+    if ((tok = strchr(line, '#')) != NULL) *tok = '\0';
+    tok = strtok(line, " \t\r\n");
+    if (tok == NULL) continue;
+    t = (uint32_t)(strtod(tok, &end) * 1000);
+    if (*end != '\0') {
+      fprintf(stderr, "%s:%d: bad time '%s'\n", path, lineno, tok);
+      fclose(f);
+      return false;
+    }
+    while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+      if (!strcmp(tok, "leds")) {
+        leds = true;
+        continue;
+      }
+      unsigned long value = strtoul(tok, &end, 16);
+      if (*end != '\0' || value > 0xFF) {
+        fprintf(stderr, "%s:%d: bad byte '%s'\n", path, lineno, tok);
+        fclose(f);
+        return false;
+      }
+      if (leds) {
+        add_event(trace, t, EV_LEDS, value);
+      }
+      else {
+        add_byte(trace, t, value);
+      }
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/*** Replay ***/
+
+#define MAX_PENDING 256
+#define UNTIMED 0xFFFFFFFF      /* Pending report made by the converter itself. */
+
+struct result {
+  struct cost byte_cost, report_cost, leds_cost;
+  unsigned long bytes, reports, merged, commands;
+  uint32_t *latency_us;
+  unsigned long nlatency;
+};
+
+/* Replay a trace with the host polling every poll_us, starting phase_us in,
+   adding to costs and latencies. */
+static void load_remap(const uint8_t *remap)
+{
+  Table_Begin(TABLE_Remap);
+  for (int offset = 0; offset < REMAP_KEYS; offset += TABLE_PIECE_SIZE) {
+    Table_Load(TABLE_Remap, offset, remap + offset);
+  }
+  Table_Swap(TABLE_Remap);
+}
+
+static void replay(const struct trace *trace, uint32_t poll_us, uint32_t phase_us,
+                   struct result *result)
+{
+  uint32_t pending_time[MAX_PENDING];
+  unsigned pending_head = 0, pending_count = 0;
+  uint32_t poll, line_free = 0, tick = 1000;
+  KeyboardReportBuffer_t report;
+  uint16_t size;
+  int i = 0;
+
+  SunKbd_InitState();
+  load_remap(trace->remap);
+  Report_SetProtocol(true);
+
+  for (poll = phase_us; i < trace->n || Report_Pending() > 0; poll += poll_us) {
+    while ((i < trace->n && trace->events[i].time_us <= poll) || tick <= poll) {
+      const struct event *ev = &trace->events[i];
+      uint64_t start, end;
+
+      if (i == trace->n || tick < ev->time_us) {
+        uint8_t before = Report_Pending();
+
+        SunKbd_MillisecondElapsed();
+        for (uint8_t n = Report_Pending(); n > before; n--) {
+          pending_time[(pending_head + pending_count++) % MAX_PENDING] = UNTIMED;
+        }
+        tick += 1000;
+        continue;
+      }
+      i++;
+
+      if (ev->kind == EV_KEY) {
+        uint8_t before = Report_Pending();
+        uint16_t overflows = ReportQueueOverflows;
+
+        start = now_ns();
+        SunKbd_ProcessByte(ev->value, ev->time_us / 4);
+        end = now_ns();
+        cost_add(&result->byte_cost, start, end);
+        result->bytes++;
+
+        if (Report_Pending() > before) {
+          /* A dual-role key tapped gives two. */
+          for (uint8_t n = Report_Pending(); n > before; n--) {
+            pending_time[(pending_head + pending_count++) % MAX_PENDING] = ev->time_us;
+          }
+        }
+        else if (ReportQueueOverflows != overflows) {
+          result->merged++;     /* Goes with the newest pending report. */
+        }
+      }
+      else {
+        start = now_ns();
+        SunKbd_SetLEDs(ev->value);
+        end = now_ns();
+        cost_add(&result->leds_cost, start, end);
+      }
+    }
+
+    /* Commands go out at the line rate. */
+    while (line_free <= poll) {
+      if (SunKbd_NextCommandByte() < 0) {
+        line_free = poll + 1;
+        break;
+      }
+      result->commands++;
+      line_free += BYTE_TIME_US;
+    }
+
+    uint64_t start = now_ns();
+    bool sent = Report_Create(&report, &size, true);
+    if (sent) Report_Sent(poll / 4);
+    uint64_t end = now_ns();
+    cost_add(&result->report_cost, start, end);
+
+    if (sent) {
+      result->reports++;
+      if (pending_count > 0) {
+        if (pending_time[pending_head] != UNTIMED) {
+          result->latency_us[result->nlatency++] = poll - pending_time[pending_head];
+        }
+        pending_head = (pending_head + 1) % MAX_PENDING;
+        pending_count--;
+      }
+    }
+  }
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+  uint32_t ua = *(const uint32_t *)a, ub = *(const uint32_t *)b;
+  return (ua > ub) - (ua < ub);
+}
+
+static double percentile(const uint32_t *sorted, unsigned long n, int p)
+{
+  if (n == 0) return 0;
+  return sorted[(n - 1) * p / 100] / 1000.0;
+}
+
+static void run_trace(struct trace *trace)
+{
+  static const uint32_t polls_us[] = { 1000, 5000 };
+
+  qsort(trace->events, trace->n, sizeof(struct event), compare_events);
+  printf("%s:\n", trace->name);
+
+  for (size_t p = 0; p < sizeof(polls_us)/sizeof(polls_us[0]); p++) {
+    struct result result;
+
+    memset(&result, 0, sizeof(result));
+    result.latency_us = malloc((trace->n + 1) * REPEATS * sizeof(uint32_t));
+    /* Each repeat moves the polls along, so latencies cover every phase. */
+    for (int r = 0; r < REPEATS; r++) {
+      replay(trace, polls_us[p], polls_us[p] * r / REPEATS, &result);
+    }
+    result.bytes /= REPEATS;
+    result.reports /= REPEATS;
+    result.merged /= REPEATS;
+    result.commands /= REPEATS;
+
+    if (p == 0) {
+      printf("  %lu bytes, %lu reports, %lu commands sent\n",
+             result.bytes, result.reports, result.commands);
+      printf("  process byte   mean %6.1f ns  max %6llu ns\n",
+             (double)result.byte_cost.total_ns / result.byte_cost.count,
+             (unsigned long long)result.byte_cost.max_ns);
+      printf("  create report  mean %6.1f ns  max %6llu ns\n",
+             (double)result.report_cost.total_ns / result.report_cost.count,
+             (unsigned long long)result.report_cost.max_ns);
+      if (result.leds_cost.count > 0) {
+        printf("  host LEDs      mean %6.1f ns  max %6llu ns\n",
+               (double)result.leds_cost.total_ns / result.leds_cost.count,
+               (unsigned long long)result.leds_cost.max_ns);
+      }
+    }
+
+    qsort(result.latency_us, result.nlatency, sizeof(uint32_t), compare_u32);
+    printf("  latency %u ms poll: p50 %5.2f  p90 %5.2f  p99 %5.2f  max %5.2f ms",
+           polls_us[p] / 1000,
+           percentile(result.latency_us, result.nlatency, 50),
+           percentile(result.latency_us, result.nlatency, 90),
+           percentile(result.latency_us, result.nlatency, 99),
+           percentile(result.latency_us, result.nlatency, 100));
+    if (result.merged > 0) printf("  (%lu merged)", result.merged);
+    printf("\n");
+    free(result.latency_us);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct trace trace;
+
+  calibrate();
+
+  memset(&trace, 0, sizeof(trace));
+  trace.name = "typing";
+  typing_trace(&trace, 2000, false);
+  run_trace(&trace);
+  free(trace.events);
+
+  memset(&trace, 0, sizeof(trace));
+  trace.name = "16-key mash";
+  mash_trace(&trace, 100);
+  run_trace(&trace);
+  free(trace.events);
+
+  memset(&trace, 0, sizeof(trace));
+  trace.name = "reset and layout";
+  reset_trace(&trace, 100);
+  run_trace(&trace);
+  free(trace.events);
+
+  memset(&trace, 0, sizeof(trace));
+  trace.name = "typing with dual-role Caps Lock";
+  trace.remap[SUN_CAPS_LOCK] = 0xE0; /* Left Control */
+  dual_role_trace(&trace, 2000);
+  run_trace(&trace);
+  free(trace.events);
+
+  memset(&trace, 0, sizeof(trace));
+  trace.name = "typing with LED storm";
+  typing_trace(&trace, 2000, true);
+  run_trace(&trace);
+  free(trace.events);
+
+  for (int i = 1; i < argc; i++) {
+    memset(&trace, 0, sizeof(trace));
+    trace.name = argv[i];
+    if (!load_trace(&trace, argv[i])) return 1;
+    run_trace(&trace);
+    free(trace.events);
+  }
+
+  return 0;
+}
@@ -0,0 +1,493 @@
+/*
+ * Host harness for the converter core. Feeds scripted Sun keyboard byte
+ * streams through SunKbd_ProcessByte() and checks the reports that the
+ * host would get from its polls.
+ *
+ * Script lines (# starts a comment):
+ *   time N               timer is now at tick N (decimal)
+ *   ms N                 N milliseconds go by
+ *   start                converter starts up the keyboard
+ *   send XX ...          bytes from the keyboard
+ *   lineerror XX         byte from the keyboard with a framing error
+ *   overrun XX           byte from the keyboard after an overrun
+ *   protocol boot|report protocol selected by the host
+ *   poll none            no new report is waiting
+ *   poll MM [KK ...]     next report has modifiers MM and key usages KK
+ *   current MM [KK ...]  current state, as for GET_REPORT
+ *   keys N               N keys are down
+ *   layout XX            keyboard layout byte is XX
+ *   overflows N          N report changes were merged for a full queue
+ *   leds XX              host sets the keyboard LEDs
+ *   click 0|1            host turns the keyclick off or on
+ *   suspend|resume       host suspends or resumes the bus
+ *   power 0|1            Power key line released or pressed
+ *   system XX|none       next control report is System Control with usage XX, or none is waiting
+ *   consumer XXXX|none   next control report is Consumer with bitmap XXXX, or none is waiting
+ *   command XX           one-shot command to the keyboard
+ *   sent XX ...|none     bytes next sent to the keyboard, all of them
+ *   latency MIN MAX N... latency range and histogram buckets, from bucket 0
+ *   stats NAME=N ...     counters: repeated, unmatched, dropped, rollover, suppressed, sent,
+ *                        losses, quarantined
+ *   set NAME=N ...       host changes settings: click, interval, tap
+ *   config NAME=N ...    settings are now as given
+ *   eeprom AT N ...|none settings write pending is N bytes at offset AT (decimal), then the next
+ *                        run, and so on, or none is
+ *   poke AT XX           EEPROM byte at offset AT is damaged to XX
+ *   reboot               converter restarts, loading settings from EEPROM
+ *   remap begin          host starts uploading a remap table
+ *   remap load AT XX ... host loads remap entries from scancode AT; the rest of the piece is 00
+ *   remap swap 0|1       host swaps the remap table in, refused (0) or taken (1)
+ *   remap read AT XX ... remap entries in use from scancode AT, the rest of the piece 00
+ *   macros ...           as for remap, for the macro table, with AT a byte offset
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SunKbd.h"
+
+#define MAX_KEYS KEYBOARD_NKRO_USAGES
+
+static bool report_protocol = true;
+static uint16_t now;
+static uint8_t eeprom[CONFIG_EEPROM_SIZE];
+
+void SunKbd_StartTransmit(void)
+{
+}
+
+uint8_t SunKbd_ReadConfig(uint16_t offset)
+{
+  return eeprom[offset];
+}
+
+void SunKbd_StartConfigWrite(void)
+{
+}
+
+static uint8_t *config_field(const char *name)
+{
+  if (!strcmp(name, "click")) return &Config.Click;
+  if (!strcmp(name, "interval")) return &Config.PollingInterval;
+  if (!strcmp(name, "tap")) return &Config.TapTime;
+  return NULL;
+}
+
+/* Decode a report of either format into modifiers and a sorted list of key usages. */
+static int decode_report(const void *data, uint16_t size,
+                         uint8_t *mods, uint8_t *keys)
+{
+  int n = 0;
+
+  if (size == sizeof(USB_KeyboardReport_Data_t)) {
+    const USB_KeyboardReport_Data_t *report = data;
+    *mods = report->Modifier;
+    for (size_t i = 0; i < sizeof(report->KeyCode); i++) {
+      if (report->KeyCode[i] != 0) keys[n++] = report->KeyCode[i];
+    }
+  }
+  else {
+    const USB_NKROKeyboardReport_Data_t *report = data;
+    *mods = report->Modifier;
+    for (int usage = 0; usage < KEYBOARD_NKRO_USAGES; usage++) {
+      if (report->KeyBitmap[usage >> 3] & (1 << (usage & 7))) keys[n++] = usage;
+    }
+  }
+
+  for (int i = 1; i < n; i++) {
+    for (int j = i; j > 0 && keys[j-1] > keys[j]; j--) {
+      uint8_t t = keys[j]; keys[j] = keys[j-1]; keys[j-1] = t;
+    }
+  }
+  return n;
+}
+
+static void format_keys(char *buf, uint8_t mods, const uint8_t *keys, int n)
+{
+  buf += sprintf(buf, "%02X", mods);
+  for (int i = 0; i < n; i++) {
+    buf += sprintf(buf, " %02X", keys[i]);
+  }
+}
+
+static int parse_table(const char *name)
+{
+  if (!strcmp(name, "remap")) return TABLE_Remap;
+  if (!strcmp(name, "macros")) return TABLE_Macros;
+  return -1;
+}
+
+static bool parse_hex(const char *tok, unsigned *value)
+{
+  char *end;
+  *value = strtoul(tok, &end, 16);
+  return *tok != '\0' && *end == '\0';
+}
+
+/* Compare a report against the expected modifiers and keys in the rest of the line. */
+static bool check_report(const void *data, uint16_t size, char **toks, int ntoks,
+                         char *got, char *want)
+{
+  uint8_t mods, keys[MAX_KEYS], wkeys[MAX_KEYS];
+  int n, wn = 0;
+  unsigned value;
+
+  n = decode_report(data, size, &mods, keys);
+  format_keys(got, mods, keys, n);
+
+  if (ntoks < 1 || !parse_hex(toks[0], &value)) return false;
+  uint8_t wmods = value;
+  for (int i = 1; i < ntoks; i++) {
+    if (!parse_hex(toks[i], &value)) return false;
+    wkeys[wn++] = value;
+  }
+  for (int i = 1; i < wn; i++) {
+    for (int j = i; j > 0 && wkeys[j-1] > wkeys[j]; j--) {
+      uint8_t t = wkeys[j]; wkeys[j] = wkeys[j-1]; wkeys[j-1] = t;
+    }
+  }
+  format_keys(want, wmods, wkeys, wn);
+  return strcmp(got, want) == 0;
+}
+
+static int run_script(const char *path)
+{
+  FILE *f;
+  char line[1024];
+  int lineno = 0, failures = 0;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  SunKbd_InitState();
+  Config_Load();
+  report_protocol = true;
+  Report_SetProtocol(report_protocol);
+  now = 0;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char *toks[KEYBOARD_NKRO_USAGES + 2], *tok;
+    int ntoks = 0;
+    char got[1024], want[1024];
+    KeyboardReportBuffer_t report;
+    uint16_t size;
+    unsigned value;
+    int table;
+    bool ok = true;
+
+    lineno++;
+    if ((tok = strchr(line, '#')) != NULL) *tok = '\0';
+    for (tok = strtok(line, " \t\r\n"); tok != NULL && ntoks < (int)(sizeof(toks)/sizeof(toks[0]));
+         tok = strtok(NULL, " \t\r\n")) {
+      toks[ntoks++] = tok;
+    }
+    if (ntoks == 0) continue;
+
+    got[0] = want[0] = '\0';
+    if (!strcmp(toks[0], "send")) {
+      for (int i = 1; i < ntoks; i++) {
+        if (!parse_hex(toks[i], &value)) {
+          ok = false;
+          break;
+        }
+        SunKbd_ProcessByte(value, now);
+      }
+    }
+    else if ((!strcmp(toks[0], "lineerror") || !strcmp(toks[0], "overrun")) && ntoks == 2) {
+      if (parse_hex(toks[1], &value)) {
+        SunKbd_LineError(value, (toks[0][0] == 'l') ? SUNKBD_LINE_FRAMING : SUNKBD_LINE_OVERRUN);
+      }
+      else {
+        ok = false;
+      }
+    }
+    else if (!strcmp(toks[0], "time") && ntoks == 2) {
+      now = atoi(toks[1]);
+    }
+    else if (!strcmp(toks[0], "ms") && ntoks == 2) {
+      for (int i = atoi(toks[1]); i > 0; i--) {
+        SunKbd_MillisecondElapsed();
+      }
+    }
+    else if (!strcmp(toks[0], "start") && ntoks == 1) {
+      SunKbd_Start();
+    }
+    else if ((!strcmp(toks[0], "suspend") || !strcmp(toks[0], "resume")) && ntoks == 1) {
+      SunKbd_Suspend(toks[0][0] == 's');
+    }
+    else if (!strcmp(toks[0], "protocol") && ntoks == 2) {
+      report_protocol = !strcmp(toks[1], "report");
+      Report_SetProtocol(report_protocol);
+    }
+    else if (!strcmp(toks[0], "poll") && ntoks == 2 && !strcmp(toks[1], "none")) {
+      if (Report_Create(&report, &size, true)) {
+        uint8_t mods, keys[MAX_KEYS];
+        int n = decode_report(&report, size, &mods, keys);
+        format_keys(got, mods, keys, n);
+        strcpy(want, "none");
+        ok = false;
+      }
+    }
+    else if (!strcmp(toks[0], "poll")) {
+      if (!Report_Create(&report, &size, true)) {
+        strcpy(got, "none");
+        ok = false;
+      }
+      else {
+        Report_Sent(now);
+        ok = check_report(&report, size, toks + 1, ntoks - 1, got, want);
+      }
+    }
+    else if (!strcmp(toks[0], "current")) {
+      Report_Create(&report, &size, false);
+      ok = check_report(&report, size, toks + 1, ntoks - 1, got, want);
+    }
+    else if (!strcmp(toks[0], "keys") && ntoks == 2) {
+      ok = (NKeysDown == atoi(toks[1]));
+      sprintf(got, "%d", NKeysDown);
+    }
+    else if (!strcmp(toks[0], "layout") && ntoks == 2) {
+      ok = parse_hex(toks[1], &value) && (KeyboardLayout == value);
+      sprintf(got, "%02X", KeyboardLayout);
+    }
+    else if (!strcmp(toks[0], "overflows") && ntoks == 2) {
+      ok = (ReportQueueOverflows == atoi(toks[1]));
+      sprintf(got, "%u", ReportQueueOverflows);
+    }
+    else if (!strcmp(toks[0], "power") && ntoks == 2) {
+      SunKbd_PowerKey(atoi(toks[1]) != 0);
+    }
+    else if ((!strcmp(toks[0], "system") || !strcmp(toks[0], "consumer")) && ntoks == 2) {
+      union {
+        USB_SystemControlReport_Data_t System;
+        USB_ConsumerReport_Data_t Consumer;
+      } control;
+      uint8_t which = (toks[0][0] == 's') ? CONTROL_REPORT_System : CONTROL_REPORT_Consumer;
+      uint8_t got_which = Control_Create(0, &control, &size, true);
+      strcpy(want, toks[1]);
+      if (got_which == 0) {
+        strcpy(got, "none");
+        ok = !strcmp(toks[1], "none");
+      }
+      else {
+        unsigned long usage;
+        if (got_which == CONTROL_REPORT_System) {
+          usage = control.System.Usage;
+          sprintf(got, "system %02lX", usage);
+        }
+        else {
+          usage = control.Consumer.Controls;
+          sprintf(got, "consumer %04lX", usage);
+        }
+        ok = (got_which == which) && strcmp(toks[1], "none") && (usage == strtoul(toks[1], NULL, 16));
+      }
+    }
+    else if (!strcmp(toks[0], "leds") && ntoks == 2 && parse_hex(toks[1], &value)) {
+      SunKbd_SetLEDs(value);
+    }
+    else if (!strcmp(toks[0], "click") && ntoks == 2) {
+      SunKbd_SetClick(atoi(toks[1]) != 0);
+    }
+    else if (!strcmp(toks[0], "command") && ntoks == 2 && parse_hex(toks[1], &value)) {
+      SunKbd_SendCommand(value);
+    }
+    else if (!strcmp(toks[0], "sent")) {
+      char *p = got;
+      int16_t next;
+      while ((next = SunKbd_NextCommandByte()) >= 0) {
+        p += sprintf(p, "%s%02X", (p == got) ? "" : " ", next);
+      }
+      if (p == got) strcpy(got, "none");
+      p = want;
+      for (int i = 1; i < ntoks; i++) {
+        if (!strcmp(toks[i], "none")) {
+          p += sprintf(p, "none");
+        }
+        else if (parse_hex(toks[i], &value)) {
+          p += sprintf(p, "%s%02X", (p == want) ? "" : " ", value);
+        }
+      }
+      ok = !strcmp(got, want);
+    }
+    else if (!strcmp(toks[0], "latency")) {
+      char *p = got;
+      int last = LATENCY_BUCKETS - 1;
+      while (last > 0 && Latency.Buckets[last] == 0) last--;
+      p += sprintf(p, "%u %u", Latency.Min, Latency.Max);
+      for (int i = 0; i <= last; i++) {
+        p += sprintf(p, " %u", Latency.Buckets[i]);
+      }
+      p = want;
+      for (int i = 1; i < ntoks; i++) {
+        p += sprintf(p, "%s%s", (i > 1) ? " " : "", toks[i]);
+      }
+      ok = !strcmp(got, want);
+    }
+    else if ((!strcmp(toks[0], "set") || !strcmp(toks[0], "config")) && ntoks > 1) {
+      bool set = (toks[0][0] == 's');
+      char *p = got;
+      for (int i = 1; i < ntoks; i++) {
+        char *eq = strchr(toks[i], '=');
+        uint8_t *field;
+        if (eq == NULL) {
+          ok = false;
+          continue;
+        }
+        *eq = '\0';
+        field = config_field(toks[i]);
+        if (field == NULL) {
+          ok = false;
+        }
+        else if (set) {
+          *field = atoi(eq + 1);
+        }
+        else {
+          p += sprintf(p, "%s%s=%u", (p == got) ? "" : " ", toks[i], *field);
+          if (*field != atoi(eq + 1)) ok = false;
+        }
+        *eq = '=';
+      }
+      if (set) {
+        Config_Changed();
+      }
+      else if (!ok) {
+        p = want;
+        for (int i = 1; i < ntoks; i++) {
+          p += sprintf(p, "%s%s", (i > 1) ? " " : "", toks[i]);
+        }
+      }
+    }
+    else if (!strcmp(toks[0], "eeprom")) {
+      uint16_t offset, first = 0, last = 0;
+      int16_t next;
+      int n = 0;
+      char *p = got;
+      while ((next = SunKbd_NextConfigByte(&offset)) >= 0) {
+        if ((n > 0) && (offset != last + 1)) {
+          p += sprintf(p, "%s%u %d", (p == got) ? "" : " ", first, n);
+          n = 0;
+        }
+        if (n++ == 0) first = offset;
+        last = offset;
+        eeprom[offset] = next;
+      }
+      if (n > 0) p += sprintf(p, "%s%u %d", (p == got) ? "" : " ", first, n);
+      if (p == got) strcpy(got, "none");
+      p = want;
+      for (int i = 1; i < ntoks; i++) {
+        p += sprintf(p, "%s%s", (i > 1) ? " " : "", toks[i]);
+      }
+      ok = !strcmp(got, want);
+    }
+    else if (!strcmp(toks[0], "poke") && ntoks == 3 && parse_hex(toks[2], &value) &&
+             atoi(toks[1]) < (int)sizeof(eeprom)) {
+      eeprom[atoi(toks[1])] = value;
+    }
+    else if ((table = parse_table(toks[0])) >= 0 && ntoks == 2 && !strcmp(toks[1], "begin")) {
+      Table_Begin(table);
+    }
+    else if ((table = parse_table(toks[0])) >= 0 && ntoks == 3 && !strcmp(toks[1], "swap")) {
+      bool swapped = Table_Swap(table);
+      ok = (swapped == (atoi(toks[2]) != 0));
+      sprintf(got, "%d", swapped);
+    }
+    else if ((table = parse_table(toks[0])) >= 0 && ntoks >= 3 && ntoks <= 3 + TABLE_PIECE_SIZE &&
+             (!strcmp(toks[1], "load") || !strcmp(toks[1], "read")) && parse_hex(toks[2], &value)) {
+      uint8_t offset = value, piece[TABLE_PIECE_SIZE] = { 0 }, current[TABLE_PIECE_SIZE];
+      for (int i = 3; i < ntoks; i++) {
+        if (!parse_hex(toks[i], &value)) ok = false;
+        piece[i - 3] = value;
+      }
+      if (toks[1][1] == 'o') {
+        Table_Load(table, offset, piece);
+      }
+      else {
+        Table_Read(table, offset, current);
+        if (memcmp(current, piece, sizeof(piece))) {
+          char *p = got, *q = want;
+          for (int i = 0; i < TABLE_PIECE_SIZE; i++) {
+            p += sprintf(p, "%s%02X", i ? " " : "", current[i]);
+            q += sprintf(q, "%s%02X", i ? " " : "", piece[i]);
+          }
+          ok = false;
+        }
+      }
+    }
+    else if (!strcmp(toks[0], "reboot") && ntoks == 1) {
+      SunKbd_InitState();
+      Config_Load();
+    }
+    else if (!strcmp(toks[0], "stats")) {
+      char *p = got;
+      for (int i = 1; i < ntoks; i++) {
+        char *eq = strchr(toks[i], '=');
+        unsigned long count;
+        if (eq == NULL) {
+          ok = false;
+          continue;
+        }
+        *eq = '\0';
+        if (!strcmp(toks[i], "repeated")) count = RepeatedPresses;
+        else if (!strcmp(toks[i], "unmatched")) count = UnmatchedReleases;
+        else if (!strcmp(toks[i], "dropped")) count = PressesDropped;
+        else if (!strcmp(toks[i], "rollover")) count = RolloverEvents;
+        else if (!strcmp(toks[i], "suppressed")) count = ReportsSuppressed;
+        else if (!strcmp(toks[i], "sent")) count = ReportsSent;
+        else if (!strcmp(toks[i], "losses")) count = KeyboardLosses;
+        else if (!strcmp(toks[i], "quarantined")) count = BytesQuarantined;
+        else {
+          ok = false;
+          continue;
+        }
+        p += sprintf(p, "%s%s=%lu", (p == got) ? "" : " ", toks[i], count);
+        if (count != strtoul(eq + 1, NULL, 10)) ok = false;
+        *eq = '=';
+      }
+      if (!ok) {
+        p = want;
+        for (int i = 1; i < ntoks; i++) {
+          p += sprintf(p, "%s%s", (i > 1) ? " " : "", toks[i]);
+        }
+      }
+    }
+    else {
+      fprintf(stderr, "%s:%d: unknown command '%s'\n", path, lineno, toks[0]);
+      ok = false;
+    }
+
+    if (!ok) {
+      fprintf(stderr, "%s:%d: %s failed", path, lineno, toks[0]);
+      if (want[0] != '\0') fprintf(stderr, ", want %s", want);
+      if (got[0] != '\0') fprintf(stderr, ", got %s", got);
+      fprintf(stderr, "\n");
+      failures++;
+    }
+  }
+
+  fclose(f);
+  return failures;
+}
+
+int main(int argc, char **argv)
+{
+  int failures = 0;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s script...\n", argv[0]);
+    return 2;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    int n = run_script(argv[i]);
+    printf("%s: %s\n", argv[i], n ? "FAIL" : "ok");
+    failures += n;
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * Cycle profile of the firmware under simavr. Runs a Keyboard.elf built
+ * with SUNKBD_PROFILE, feeds USART1 the keyboard bytes from traces in the
+ * format that test/bench reads, and reports the cycles spent in each
+ * section marked in src/Profile.h, and the longest pass of the main loop.
+ *
+ * Section times are inclusive: interrupts taken inside a main loop
+ * section are charged to it as well as to themselves. Interrupt entry and
+ * exit sequences are outside the markers.
+ *
+ * Fails if an EEPROM write is started in an interrupt section other than
+ * the EEPROM ready interrupt, which is where settings are written a byte
+ * at a time, or if an interrupt section runs longer than the limit given
+ * with -l. Writes are caught at EECR, alongside simavr's own EEPROM
+ * model, so a blocking eeprom_write_byte() is caught as well.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "sim_irq.h"
+#include "avr_uart.h"
+
+#include "Profile.h"
+
+#define MCU "atmega32u4"
+#define F_CPU 16000000
+#define GPIOR0_ADDR 0x3E        /* Data space address on the ATmega32U4 */
+#define EECR_ADDR 0x3F
+#define EECR_EEPE 0x02
+#define TAIL_MS 200             /* Run on after the last byte. */
+#define MAX_DEPTH 16
+
+struct section {
+  const char *name;
+  unsigned long calls;
+  uint64_t total, max;
+};
+
+static struct section Sections[PROFILE_EXIT_FLAG] = {
+  [PROFILE_MainLoop]      = { "main loop" },
+  [PROFILE_SunKbdTask]    = { "SunKbd_Task" },
+  [PROFILE_HIDTask]       = { "HID_Device_USBTask" },
+  [PROFILE_USBTask]       = { "USB_USBTask" },
+  [PROFILE_CreateReport]  = { "CreateHIDReport" },
+  [PROFILE_ProcessReport] = { "ProcessHIDReport" },
+  [PROFILE_RxISR]         = { "USART1_RX_vect" },
+  [PROFILE_UdreISR]       = { "USART1_UDRE_vect" },
+  [PROFILE_StartOfFrame]  = { "StartOfFrame (USB_GEN_vect)" },
+  [PROFILE_TimerISR]      = { "TIMER1_COMPA_vect" },
+  [PROFILE_EEReadyISR]    = { "EE_READY_vect" },
+};
+
+static struct {
+  uint8_t id;
+  avr_cycle_count_t start;
+} Stack[MAX_DEPTH];
+static int Depth;
+
+static unsigned long Violations, BytesSent, EEPROMWrites;
+
+static void marker_write(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  uint8_t id = v & ~PROFILE_EXIT_FLAG;
+
+  if (!(v & PROFILE_EXIT_FLAG)) {
+    if (Depth == MAX_DEPTH) {
+      fprintf(stderr, "cycle %llu: sections nested too deep\n", (unsigned long long)avr->cycle);
+      exit(2);
+    }
+    Stack[Depth].id = id;
+    Stack[Depth].start = avr->cycle;
+    Depth++;
+    return;
+  }
+
+  // Exits pair with the innermost matching entry.
+  for (int i = Depth - 1; i >= 0; i--) {
+    if (Stack[i].id == id) {
+      struct section *section = &Sections[id];
+      uint64_t cycles = avr->cycle - Stack[i].start;
+      section->calls++;
+      section->total += cycles;
+      if (cycles > section->max) section->max = cycles;
+      Depth = i;
+      return;
+    }
+  }
+  fprintf(stderr, "cycle %llu: exit from %s without entry\n",
+          (unsigned long long)avr->cycle, Sections[id].name ? Sections[id].name : "?");
+}
+
+static void eecr_write(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  if (!(v & EECR_EEPE)) return;
+
+  EEPROMWrites++;
+  for (int i = 0; i < Depth; i++) {
+    if ((Stack[i].id >= PROFILE_FirstISR) && (Stack[i].id != PROFILE_EEReadyISR)) {
+      fprintf(stderr, "cycle %llu: EEPROM write in %s\n",
+              (unsigned long long)avr->cycle, Sections[Stack[i].id].name);
+      Violations++;
+      break;
+    }
+  }
+}
+
+static void uart_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  BytesSent++;
+}
+
+struct byte {
+  avr_cycle_count_t cycle;
+  uint8_t value;
+};
+
+static struct byte *Bytes;
+static int NBytes, SizeBytes;
+
+static avr_cycle_count_t ms_to_cycles(double ms)
+{
+  return (avr_cycle_count_t)(ms * (F_CPU / 1000));
+}
+
+/* Keyboard bytes from a trace; host LED changes need a USB host and are skipped. */
+static bool load_trace(const char *path, avr_cycle_count_t offset, avr_cycle_count_t *end)
+{
+  FILE *f;
+  char line[1024];
+  int lineno = 0;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char *tok, *endp;
+    avr_cycle_count_t cycle;
+
+    lineno++;
+    if ((tok = strchr(line, '#')) != NULL) *tok = '\0';
+    tok = strtok(line, " \t\r\n");
+    if (tok == NULL) continue;
+    cycle = offset + ms_to_cycles(strtod(tok, &endp));
+    if (*endp != '\0') {
+      fprintf(stderr, "%s:%d: bad time '%s'\n", path, lineno, tok);
+      fclose(f);
+      return false;
+    }
+    while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+      if (!strcmp(tok, "leds")) break;
+      unsigned long value = strtoul(tok, &endp, 16);
+      if (*endp != '\0' || value > 0xFF) {
+        fprintf(stderr, "%s:%d: bad byte '%s'\n", path, lineno, tok);
+        fclose(f);
+        return false;
+      }
+      if (NBytes == SizeBytes) {
+        SizeBytes = SizeBytes ? SizeBytes * 2 : 256;
+        Bytes = realloc(Bytes, SizeBytes * sizeof(struct byte));
+        if (Bytes == NULL) {
+          perror("realloc");
+          exit(2);
+        }
+      }
+      Bytes[NBytes].cycle = cycle;
+      Bytes[NBytes].value = value;
+      NBytes++;
+      if (cycle > *end) *end = cycle;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-l isr-cycle-limit] [-s startup-ms] firmware.elf [trace...]\n", prog);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  elf_firmware_t firmware;
+  avr_t *avr;
+  avr_irq_t *uart_in;
+  uint32_t flags = 0;
+  avr_cycle_count_t end, limit = 0;
+  double startup_ms = 500;
+  int opt, next = 0, state;
+
+  while ((opt = getopt(argc, argv, "l:s:")) != -1) {
+    switch (opt) {
+    case 'l':
+      limit = strtoull(optarg, NULL, 0);
+      break;
+    case 's':
+      startup_ms = strtod(optarg, NULL);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc) usage(argv[0]);
+
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[optind], &firmware) != 0) {
+    fprintf(stderr, "%s: cannot read firmware\n", argv[optind]);
+    return 2;
+  }
+  if (firmware.mmcu[0] == '\0') strcpy(firmware.mmcu, MCU);
+  if (firmware.frequency == 0) firmware.frequency = F_CPU;
+
+  avr = avr_make_mcu_by_name(firmware.mmcu);
+  if (avr == NULL) {
+    fprintf(stderr, "%s: simavr does not know this MCU\n", firmware.mmcu);
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+
+  avr_register_io_write(avr, GPIOR0_ADDR, marker_write, NULL);
+  avr_register_io_write(avr, EECR_ADDR, eecr_write, NULL);
+
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('1'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('1'), &flags);
+  uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_OUTPUT),
+                          uart_output, NULL);
+
+  // Traces play one after another, once the firmware has started.
+  end = ms_to_cycles(startup_ms);
+  for (int i = optind + 1; i < argc; i++) {
+    if (!load_trace(argv[i], end, &end)) return 2;
+    end += ms_to_cycles(TAIL_MS);
+  }
+
+  do {
+    while ((next < NBytes) && (Bytes[next].cycle <= avr->cycle)) {
+      avr_raise_irq(uart_in, Bytes[next].value);
+      next++;
+    }
+    state = avr_run(avr);
+  } while ((state != cpu_Done) && (state != cpu_Crashed) && (avr->cycle < end));
+
+  if (state == cpu_Crashed) {
+    fprintf(stderr, "cycle %llu: firmware crashed\n", (unsigned long long)avr->cycle);
+    Violations++;
+  }
+
+  printf("%d bytes in, %lu bytes out, %lu EEPROM writes, %.1f ms simulated\n",
+         NBytes, BytesSent, EEPROMWrites, (double)avr->cycle / (F_CPU / 1000));
+  printf("%-28s %8s %12s %12s %10s\n", "section", "calls", "mean cycles", "max cycles", "max us");
+  for (int id = 0; id < PROFILE_EXIT_FLAG; id++) {
+    struct section *section = &Sections[id];
+    if (section->name == NULL) continue;
+    if (section->calls == 0) {
+      printf("%-28s %8s\n", section->name, "-");
+      continue;
+    }
+    printf("%-28s %8lu %12.1f %12llu %10.1f\n",
+           section->name, section->calls, (double)section->total / section->calls,
+           (unsigned long long)section->max, (double)section->max * 1e6 / F_CPU);
+    if ((id >= PROFILE_FirstISR) && (limit > 0) && (section->max > limit)) {
+      fprintf(stderr, "%s took %llu cycles, over the limit of %llu\n",
+              section->name, (unsigned long long)section->max, (unsigned long long)limit);
+      Violations++;
+    }
+  }
+  printf("longest main loop pass: %llu cycles (%.1f us)\n",
+         (unsigned long long)Sections[PROFILE_MainLoop].max,
+         (double)Sections[PROFILE_MainLoop].max * 1e6 / F_CPU);
+
+  return Violations ? 1 : 0;
+}
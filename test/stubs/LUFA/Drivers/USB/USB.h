@@ -0,0 +1,178 @@
+/** \file
+ *
+ *  Host stand-in for the parts of the LUFA USB headers that the converter core uses:
+ *  HID keyboard usages, modifier and LED masks, and the boot keyboard report.
+ *  Values are from the USB HID Usage Tables, as in LUFA's HIDClassCommon.h.
+ */
+
+#ifndef _STUB_LUFA_USB_H_
+#define _STUB_LUFA_USB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ATTR_PACKED                 __attribute__((packed))
+#define ATTR_WARN_UNUSED_RESULT     __attribute__((warn_unused_result))
+#define ATTR_NON_NULL_PTR_ARG(...)  __attribute__((nonnull (__VA_ARGS__)))
+
+#define ENDPOINT_DIR_IN             0x80
+
+#define HID_KEYBOARD_MODIFIER_LEFTCTRL   (1 << 0)
+#define HID_KEYBOARD_MODIFIER_LEFTSHIFT  (1 << 1)
+#define HID_KEYBOARD_MODIFIER_LEFTALT    (1 << 2)
+#define HID_KEYBOARD_MODIFIER_LEFTGUI    (1 << 3)
+#define HID_KEYBOARD_MODIFIER_RIGHTCTRL  (1 << 4)
+#define HID_KEYBOARD_MODIFIER_RIGHTSHIFT (1 << 5)
+#define HID_KEYBOARD_MODIFIER_RIGHTALT   (1 << 6)
+#define HID_KEYBOARD_MODIFIER_RIGHTGUI   (1 << 7)
+
+#define HID_KEYBOARD_LED_NUMLOCK    (1 << 0)
+#define HID_KEYBOARD_LED_CAPSLOCK   (1 << 1)
+#define HID_KEYBOARD_LED_SCROLLLOCK (1 << 2)
+#define HID_KEYBOARD_LED_COMPOSE    (1 << 3)
+#define HID_KEYBOARD_LED_KANA       (1 << 4)
+
+#define HID_KEYBOARD_SC_ERROR_ROLLOVER                    0x01
+#define HID_KEYBOARD_SC_A                                 0x04
+#define HID_KEYBOARD_SC_B                                 0x05
+#define HID_KEYBOARD_SC_C                                 0x06
+#define HID_KEYBOARD_SC_D                                 0x07
+#define HID_KEYBOARD_SC_E                                 0x08
+#define HID_KEYBOARD_SC_F                                 0x09
+#define HID_KEYBOARD_SC_G                                 0x0A
+#define HID_KEYBOARD_SC_H                                 0x0B
+#define HID_KEYBOARD_SC_I                                 0x0C
+#define HID_KEYBOARD_SC_J                                 0x0D
+#define HID_KEYBOARD_SC_K                                 0x0E
+#define HID_KEYBOARD_SC_L                                 0x0F
+#define HID_KEYBOARD_SC_M                                 0x10
+#define HID_KEYBOARD_SC_N                                 0x11
+#define HID_KEYBOARD_SC_O                                 0x12
+#define HID_KEYBOARD_SC_P                                 0x13
+#define HID_KEYBOARD_SC_Q                                 0x14
+#define HID_KEYBOARD_SC_R                                 0x15
+#define HID_KEYBOARD_SC_S                                 0x16
+#define HID_KEYBOARD_SC_T                                 0x17
+#define HID_KEYBOARD_SC_U                                 0x18
+#define HID_KEYBOARD_SC_V                                 0x19
+#define HID_KEYBOARD_SC_W                                 0x1A
+#define HID_KEYBOARD_SC_X                                 0x1B
+#define HID_KEYBOARD_SC_Y                                 0x1C
+#define HID_KEYBOARD_SC_Z                                 0x1D
+#define HID_KEYBOARD_SC_1_AND_EXCLAMATION                 0x1E
+#define HID_KEYBOARD_SC_2_AND_AT                          0x1F
+#define HID_KEYBOARD_SC_3_AND_HASHMARK                    0x20
+#define HID_KEYBOARD_SC_4_AND_DOLLAR                      0x21
+#define HID_KEYBOARD_SC_5_AND_PERCENTAGE                  0x22
+#define HID_KEYBOARD_SC_6_AND_CARET                       0x23
+#define HID_KEYBOARD_SC_7_AND_AMPERSAND                   0x24
+#define HID_KEYBOARD_SC_8_AND_ASTERISK                    0x25
+#define HID_KEYBOARD_SC_9_AND_OPENING_PARENTHESIS         0x26
+#define HID_KEYBOARD_SC_0_AND_CLOSING_PARENTHESIS         0x27
+#define HID_KEYBOARD_SC_ENTER                             0x28
+#define HID_KEYBOARD_SC_ESCAPE                            0x29
+#define HID_KEYBOARD_SC_BACKSPACE                         0x2A
+#define HID_KEYBOARD_SC_TAB                               0x2B
+#define HID_KEYBOARD_SC_SPACE                             0x2C
+#define HID_KEYBOARD_SC_MINUS_AND_UNDERSCORE              0x2D
+#define HID_KEYBOARD_SC_EQUAL_AND_PLUS                    0x2E
+#define HID_KEYBOARD_SC_OPENING_BRACKET_AND_OPENING_BRACE 0x2F
+#define HID_KEYBOARD_SC_CLOSING_BRACKET_AND_CLOSING_BRACE 0x30
+#define HID_KEYBOARD_SC_BACKSLASH_AND_PIPE                0x31
+#define HID_KEYBOARD_SC_NON_US_HASHMARK_AND_TILDE         0x32
+#define HID_KEYBOARD_SC_SEMICOLON_AND_COLON               0x33
+#define HID_KEYBOARD_SC_APOSTROPHE_AND_QUOTE              0x34
+#define HID_KEYBOARD_SC_GRAVE_ACCENT_AND_TILDE            0x35
+#define HID_KEYBOARD_SC_COMMA_AND_LESS_THAN_SIGN          0x36
+#define HID_KEYBOARD_SC_DOT_AND_GREATER_THAN_SIGN         0x37
+#define HID_KEYBOARD_SC_SLASH_AND_QUESTION_MARK           0x38
+#define HID_KEYBOARD_SC_CAPS_LOCK                         0x39
+#define HID_KEYBOARD_SC_F1                                0x3A
+#define HID_KEYBOARD_SC_F2                                0x3B
+#define HID_KEYBOARD_SC_F3                                0x3C
+#define HID_KEYBOARD_SC_F4                                0x3D
+#define HID_KEYBOARD_SC_F5                                0x3E
+#define HID_KEYBOARD_SC_F6                                0x3F
+#define HID_KEYBOARD_SC_F7                                0x40
+#define HID_KEYBOARD_SC_F8                                0x41
+#define HID_KEYBOARD_SC_F9                                0x42
+#define HID_KEYBOARD_SC_F10                               0x43
+#define HID_KEYBOARD_SC_F11                               0x44
+#define HID_KEYBOARD_SC_F12                               0x45
+#define HID_KEYBOARD_SC_PRINT_SCREEN                      0x46
+#define HID_KEYBOARD_SC_SCROLL_LOCK                       0x47
+#define HID_KEYBOARD_SC_PAUSE                             0x48
+#define HID_KEYBOARD_SC_INSERT                            0x49
+#define HID_KEYBOARD_SC_HOME                              0x4A
+#define HID_KEYBOARD_SC_PAGE_UP                           0x4B
+#define HID_KEYBOARD_SC_DELETE                            0x4C
+#define HID_KEYBOARD_SC_END                               0x4D
+#define HID_KEYBOARD_SC_PAGE_DOWN                         0x4E
+#define HID_KEYBOARD_SC_RIGHT_ARROW                       0x4F
+#define HID_KEYBOARD_SC_LEFT_ARROW                        0x50
+#define HID_KEYBOARD_SC_DOWN_ARROW                        0x51
+#define HID_KEYBOARD_SC_UP_ARROW                          0x52
+#define HID_KEYBOARD_SC_NUM_LOCK                          0x53
+#define HID_KEYBOARD_SC_KEYPAD_SLASH                      0x54
+#define HID_KEYBOARD_SC_KEYPAD_ASTERISK                   0x55
+#define HID_KEYBOARD_SC_KEYPAD_MINUS                      0x56
+#define HID_KEYBOARD_SC_KEYPAD_PLUS                       0x57
+#define HID_KEYBOARD_SC_KEYPAD_ENTER                      0x58
+#define HID_KEYBOARD_SC_KEYPAD_1_AND_END                  0x59
+#define HID_KEYBOARD_SC_KEYPAD_2_AND_DOWN_ARROW           0x5A
+#define HID_KEYBOARD_SC_KEYPAD_3_AND_PAGE_DOWN            0x5B
+#define HID_KEYBOARD_SC_KEYPAD_4_AND_LEFT_ARROW           0x5C
+#define HID_KEYBOARD_SC_KEYPAD_5                          0x5D
+#define HID_KEYBOARD_SC_KEYPAD_6_AND_RIGHT_ARROW          0x5E
+#define HID_KEYBOARD_SC_KEYPAD_7_AND_HOME                 0x5F
+#define HID_KEYBOARD_SC_KEYPAD_8_AND_UP_ARROW             0x60
+#define HID_KEYBOARD_SC_KEYPAD_9_AND_PAGE_UP              0x61
+#define HID_KEYBOARD_SC_KEYPAD_0_AND_INSERT               0x62
+#define HID_KEYBOARD_SC_KEYPAD_DOT_AND_DELETE             0x63
+#define HID_KEYBOARD_SC_NON_US_BACKSLASH_AND_PIPE         0x64
+#define HID_KEYBOARD_SC_APPLICATION                       0x65
+#define HID_KEYBOARD_SC_POWER                             0x66
+#define HID_KEYBOARD_SC_KEYPAD_EQUAL_SIGN                 0x67
+#define HID_KEYBOARD_SC_F13                               0x68
+#define HID_KEYBOARD_SC_F14                               0x69
+#define HID_KEYBOARD_SC_F15                               0x6A
+#define HID_KEYBOARD_SC_F16                               0x6B
+#define HID_KEYBOARD_SC_F17                               0x6C
+#define HID_KEYBOARD_SC_F18                               0x6D
+#define HID_KEYBOARD_SC_F19                               0x6E
+#define HID_KEYBOARD_SC_F20                               0x6F
+#define HID_KEYBOARD_SC_F21                               0x70
+#define HID_KEYBOARD_SC_F22                               0x71
+#define HID_KEYBOARD_SC_F23                               0x72
+#define HID_KEYBOARD_SC_F24                               0x73
+#define HID_KEYBOARD_SC_EXECUTE                           0x74
+#define HID_KEYBOARD_SC_HELP                              0x75
+#define HID_KEYBOARD_SC_MENU                              0x76
+#define HID_KEYBOARD_SC_SELECT                            0x77
+#define HID_KEYBOARD_SC_STOP                              0x78
+#define HID_KEYBOARD_SC_AGAIN                             0x79
+#define HID_KEYBOARD_SC_UNDO                              0x7A
+#define HID_KEYBOARD_SC_CUT                               0x7B
+#define HID_KEYBOARD_SC_COPY                              0x7C
+#define HID_KEYBOARD_SC_PASTE                             0x7D
+#define HID_KEYBOARD_SC_FIND                              0x7E
+#define HID_KEYBOARD_SC_MUTE                              0x7F
+#define HID_KEYBOARD_SC_VOLUME_UP                         0x80
+#define HID_KEYBOARD_SC_VOLUME_DOWN                       0x81
+#define HID_KEYBOARD_SC_LEFT_CONTROL                      0xE0
+#define HID_KEYBOARD_SC_LEFT_SHIFT                        0xE1
+#define HID_KEYBOARD_SC_LEFT_ALT                          0xE2
+#define HID_KEYBOARD_SC_LEFT_GUI                          0xE3
+#define HID_KEYBOARD_SC_RIGHT_CONTROL                     0xE4
+#define HID_KEYBOARD_SC_RIGHT_SHIFT                       0xE5
+#define HID_KEYBOARD_SC_RIGHT_ALT                         0xE6
+#define HID_KEYBOARD_SC_RIGHT_GUI                         0xE7
+
+typedef struct
+{
+  uint8_t Modifier;
+  uint8_t Reserved;
+  uint8_t KeyCode[6];
+} ATTR_PACKED USB_KeyboardReport_Data_t;
+
+#endif
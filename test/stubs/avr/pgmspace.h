@@ -0,0 +1,18 @@
+/** \file
+ *
+ *  Host stand-in for avr/pgmspace.h: program memory is ordinary memory.
+ */
+
+#ifndef _STUB_AVR_PGMSPACE_H_
+#define _STUB_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)           (s)
+#define pgm_read_byte(p)  (*(const uint8_t*)(p))
+#define pgm_read_word(p)  (*(const uint16_t*)(p))
+#define memcpy_P          memcpy
+
+#endif
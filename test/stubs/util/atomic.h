@@ -0,0 +1,14 @@
+/** \file
+ *
+ *  Host stand-in for util/atomic.h: the host build is single threaded, so an
+ *  atomic block is just a block.
+ */
+
+#ifndef _STUB_UTIL_ATOMIC_H_
+#define _STUB_UTIL_ATOMIC_H_
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (int _atomic_once = 1; _atomic_once; _atomic_once = 0)
+
+#endif
@@ -0,0 +1,54 @@
+/* Generated by src/genlayouts.py from src/layouts.txt; do not edit. */
+
+static const struct {
+  unsigned char code;
+  const char *name;
+} layout_names[] = {
+  { 0x00, "Type 4 / United States" },
+  { 0x01, "Type 4 / United States" },
+  { 0x02, "Type 4 / Belgium / French" },
+  { 0x03, "Type 4 / Canada / French" },
+  { 0x04, "Type 4 / Denmark" },
+  { 0x05, "Type 4 / Germany" },
+  { 0x06, "Type 4 / Italy" },
+  { 0x07, "Type 4 / Netherlands" },
+  { 0x08, "Type 4 / Norway" },
+  { 0x09, "Type 4 / Portugal" },
+  { 0x0A, "Type 4 / America / Spanish" },
+  { 0x0B, "Type 4 / Sweden, Finland" },
+  { 0x0C, "Type 4 / Switzerland / French" },
+  { 0x0D, "Type 4 / Switzerland / German" },
+  { 0x0E, "Type 4 / Great Britain" },
+  { 0x10, "Type 4 / Korea" },
+  { 0x11, "Type 4 / Taiwan" },
+  { 0x17, "Type 4 / Russia" },
+  { 0x21, "Type 5 / United States" },
+  { 0x22, "Type 5 / United States / UNIX" },
+  { 0x23, "Type 5 / France" },
+  { 0x24, "Type 5 / Denmark" },
+  { 0x25, "Type 5 / Germany" },
+  { 0x26, "Type 5 / Italy" },
+  { 0x27, "Type 5 / Netherlands" },
+  { 0x28, "Type 5 / Norway" },
+  { 0x29, "Type 5 / Portugal" },
+  { 0x2A, "Type 5 / Spain" },
+  { 0x2B, "Type 5 / Sweden" },
+  { 0x2C, "Type 5 / Switzerland / French" },
+  { 0x2D, "Type 5 / Switzerland / German" },
+  { 0x2E, "Type 5 / Great Britain" },
+  { 0x2F, "Type 5 / Korea" },
+  { 0x30, "Type 5 / Taiwan" },
+  { 0x31, "Type 5 / Japan" },
+  { 0x32, "Type 5 / Canada / French" },
+  { 0x33, "Type 5 / Hungary" },
+  { 0x34, "Type 5 / Poland" },
+  { 0x35, "Type 5 / Czech" },
+  { 0x36, "Type 5 / Russia" },
+  { 0x37, "Type 5 / Latvia" },
+  { 0x38, "Type 5 / Turkey" },
+  { 0x39, "Type 5 / Greece" },
+  { 0x3A, "Type 5 / Arabic" },
+  { 0x3B, "Type 5 / Lithuania" },
+  { 0x3C, "Type 5 / Belgium" },
+  { 0x3E, "Type 5 / Canada / French" },
+};
@@ -11,10 +11,34 @@
 #include <sys/ioctl.h>
 #include <linux/hidraw.h>
 
+#include "layouts.h"
+
 #define SUNKBD_LAYOUT_5_MASK 0x20
 
+#define REPORT_ID_SETTINGS 2
+#define REPORT_ID_LATENCY 3
+#define REPORT_ID_STATS 4
+#define REPORT_ID_REMAP 7
+#define REPORT_ID_MACROS 8
+
+#define LATENCY_BUCKETS 16
+
+#define REMAP_KEYS 128
+#define MACRO_BYTES 128
+#define MACRO_COUNT 11
+#define MACRO_FIRST 0xA5
+#define TABLE_PIECE_SIZE 16
+#define TABLE_COMMAND_BEGIN 1
+#define TABLE_COMMAND_LOAD 2
+#define TABLE_COMMAND_SWAP 3
+#define TABLE_COMMAND_READ 4
+#define TABLE_SWAP_TRIES 20     /* The keyboard refuses while it writes EEPROM. */
+#define DEFAULT_TAP_TIME 200    /* SUNKBD_TAP_MS, when none is set. */
+#define REOPEN_WAIT_US 500000   /* For the keyboard to go, after a reconnect. */
+#define REOPEN_TRIES 50
+
 static const char *VENDOR = "23fd", *PRODUCT = "206a";
-static bool find_sunkbd(char *device)
+static bool find_sunkbd(char *device, bool required)
 {
   struct udev *udev;
   struct udev_enumerate *enumerate;
@@ -61,28 +85,409 @@ static bool find_sunkbd(char *device)
   udev_unref(udev);
 
   if (device[0] == '\0') {
-    fprintf(stderr, "Keyboard not found.\n");
+    if (required) fprintf(stderr, "Keyboard not found.\n");
     return false;
   }
   return true;
 }
 
+/* After the polling interval changes, the keyboard drops off the bus and comes back with
+   a new descriptor. Wait for it and open it again. */
+static int reopen_device(int fd, char *device, bool found)
+{
+  close(fd);
+  usleep(REOPEN_WAIT_US);
+  for (int i = 0; i < REOPEN_TRIES; i++) {
+    if (found) device[0] = '\0';
+    if (!found || find_sunkbd(device, false)) {
+      fd = open(device, O_RDWR|O_NONBLOCK);
+      if (fd >= 0) return fd;
+    }
+    usleep(100000);
+  }
+  fprintf(stderr, "Keyboard did not come back after reconnecting.\n");
+  return -1;
+}
+
 static char device[PATH_MAX] = { 0 };
 static int click = -1;
+static int poll_interval = -1;
+static int tap_time = -1;
+static int latency = 0;
+static int clear_latency = 0;
+static int stats = 0;
+static int clear_stats = 0;
+static const char *map_file = NULL;
+static const char *macro_file = NULL;
+static char macro_names[MACRO_COUNT][32]; /* From the macro file, "" if unnamed. */
 
 static struct option long_options[] = {
   {"click", no_argument, &click, 1},
   {"no-click", no_argument, &click, 0},
+  {"poll", required_argument, NULL, 'p'},
+  {"tap-time", required_argument, NULL, 't'},
+  {"latency", no_argument, &latency, 1},
+  {"clear-latency", no_argument, &clear_latency, 1},
+  {"stats", no_argument, &stats, 1},
+  {"clear-stats", no_argument, &clear_stats, 1},
+  {"load-map", required_argument, NULL, 'm'},
+  {"load-macros", required_argument, NULL, 'M'},
   {NULL, 0, 0, 0}
 };
 
 #define countof(x) (sizeof(x)/sizeof(x[0]))
 
+static unsigned get16(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static int show_latency(int fd)
+{
+  int rc;
+  unsigned char buf[2 + 2 * 2 + LATENCY_BUCKETS * 2];
+  unsigned tick, min, max, total = 0;
+
+  buf[0] = REPORT_ID_LATENCY;
+  rc = ioctl(fd, HIDIOCGFEATURE(sizeof(buf)), buf);
+  if (rc < 0) {
+    perror("Error getting latency report");
+    return 1;
+  }
+  if (rc != sizeof(buf)) {
+    fprintf(stderr, "Incorrect latency report: %d", rc);
+    return 1;
+  }
+
+  tick = buf[1];
+  min = get16(buf + 2);
+  max = get16(buf + 4);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    total += get16(buf + 6 + i * 2);
+  }
+  if (total == 0) {
+    printf("Latency = no keystrokes yet\n");
+    return 0;
+  }
+  printf("Latency = %u reports, min %u us, max %u us\n", total, min * tick, max * tick);
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    unsigned count = get16(buf + 6 + i * 2);
+    unsigned low = (i == 0) ? 0 : (1u << (i - 1)) * tick;
+    if (count == 0) continue;
+    if (i == LATENCY_BUCKETS - 1) {
+      printf("  %6u us and up: %u\n", low, count);
+    }
+    else {
+      printf("  %6u - %6u us: %u\n", low, (1u << i) * tick, count);
+    }
+  }
+  return 0;
+}
+
+static int reset_latency(int fd)
+{
+  unsigned char buf[2 + 2 * 2 + LATENCY_BUCKETS * 2];
+
+  memset(buf, 0, sizeof(buf));
+  buf[0] = REPORT_ID_LATENCY;
+  if (ioctl(fd, HIDIOCSFEATURE(sizeof(buf)), buf) < 0) {
+    perror("Error clearing latency report");
+    return 1;
+  }
+  return 0;
+}
+
+static unsigned long get32(const unsigned char *p)
+{
+  return get16(p) | ((unsigned long)get16(p + 2) << 16);
+}
+
+#define STATS_SIZE (1 + 1 + 4 + 2 * 6 + 4 + 2 * 10)
+
+static int show_stats(int fd)
+{
+  int rc;
+  unsigned char buf[STATS_SIZE];
+  const unsigned char *p;
+  unsigned tick;
+
+  buf[0] = REPORT_ID_STATS;
+  rc = ioctl(fd, HIDIOCGFEATURE(sizeof(buf)), buf);
+  if (rc < 0) {
+    perror("Error getting counters report");
+    return 1;
+  }
+  if (rc != sizeof(buf)) {
+    fprintf(stderr, "Incorrect counters report: %d", rc);
+    return 1;
+  }
+
+  tick = buf[1];
+  p = buf + 2;
+  printf("Bytes received = %lu\n", get32(p)); p += 4;
+  printf("Framing errors = %u\n", get16(p)); p += 2;
+  printf("Overruns = %u\n", get16(p)); p += 2;
+  printf("Receive buffer full = %u\n", get16(p)); p += 2;
+  printf("Repeated presses = %u\n", get16(p)); p += 2;
+  printf("Unmatched releases = %u\n", get16(p)); p += 2;
+  printf("Rollovers = %u\n", get16(p)); p += 2;
+  printf("Reports sent = %lu\n", get32(p)); p += 4;
+  printf("Reports suppressed = %u\n", get16(p)); p += 2;
+  printf("Report queue overflows = %u\n", get16(p)); p += 2;
+  printf("Commands queued = %u\n", get16(p)); p += 2;
+  printf("Commands coalesced = %u\n", get16(p)); p += 2;
+  printf("Max main loop = %u us\n", get16(p) * tick); p += 2;
+  printf("Keyboard losses = %u\n", get16(p)); p += 2;
+  printf("Bytes quarantined = %u\n", get16(p)); p += 2;
+  printf("Awake = %.1f %%", get16(p) / 10.0); p += 2;
+  printf(", at most %.1f %%\n", get16(p) / 10.0); p += 2;
+  printf("Presses dropped = %u\n", get16(p));
+  return 0;
+}
+
+static int reset_stats(int fd)
+{
+  unsigned char buf[STATS_SIZE];
+
+  memset(buf, 0, sizeof(buf));
+  buf[0] = REPORT_ID_STATS;
+  if (ioctl(fd, HIDIOCSFEATURE(sizeof(buf)), buf) < 0) {
+    perror("Error clearing counters report");
+    return 1;
+  }
+  return 0;
+}
+
+/* Parse a whole word as a hex number up to FF. Returns -1 if it is not one. */
+static int parse_hex(const char *word)
+{
+  char *end;
+  unsigned long value;
+
+  value = strtoul(word, &end, 16);
+  if ((end == word) || (*end != '\0') || (value > 0xFF)) return -1;
+  return value;
+}
+
+/* Keymap code of the macro with the given name, or -1 if there is none. */
+static int find_macro(const char *name)
+{
+  for (int i = 0; i < MACRO_COUNT; i++) {
+    if (!strcmp(macro_names[i], name)) return MACRO_FIRST + i;
+  }
+  return -1;
+}
+
+/* A map file has a Sun scancode in hex on each line, and the keymap code to send for it, in
+ * hex, or the name of a macro from the macro file; # starts a comment. Keys not in the file
+ * stay as the layout has them.
+ */
+static int read_map(const char *path, unsigned char *map)
+{
+  FILE *f;
+  char line[256];
+  int lineno = 0;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return 1;
+  }
+  memset(map, 0, REMAP_KEYS);
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char *word, *arg;
+    int key, code;
+
+    lineno++;
+    if ((word = strchr(line, '#')) != NULL) *word = '\0';
+    word = strtok(line, " \t\r\n");
+    if (word == NULL) continue;
+    arg = strtok(NULL, " \t\r\n");
+    key = parse_hex(word);
+    code = -1;
+    if ((arg != NULL) && (strtok(NULL, " \t\r\n") == NULL)) {
+      code = parse_hex(arg);
+      if (code < 0) code = find_macro(arg);
+    }
+    if ((key < 0) || (key >= REMAP_KEYS) || (code < 0)) {
+      fprintf(stderr, "%s:%d: expected scancode and keymap code or macro name\n", path, lineno);
+      fclose(f);
+      return 1;
+    }
+    map[key] = code;
+  }
+  fclose(f);
+  return 0;
+}
+
+/* A macro file has a "macro" line, with an optional name, to start each macro, for keymap
+ * codes A5, A6 and so on in turn, followed by its steps: "press", "release" or "tap" and a
+ * keymap code in hex, or "wait" and milliseconds; # starts a comment. Bind keys to the
+ * macros with a map file, by code or by name.
+ */
+static int read_macros(const char *path, unsigned char *macros, int *count)
+{
+  static const struct {
+    const char *name;
+    unsigned char step;
+    int base;
+  } steps[] = {
+    { "press", 0x01, 16 }, { "release", 0x02, 16 }, { "tap", 0x03, 16 }, { "wait", 0x04, 10 },
+  };
+  FILE *f;
+  char line[256];
+  int lineno = 0, size = 0;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return 1;
+  }
+  memset(macros, 0, MACRO_BYTES);
+  memset(macro_names, 0, sizeof(macro_names));
+  *count = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char *word, *arg, *rest;
+    unsigned long value;
+    size_t i;
+
+    lineno++;
+    if ((word = strchr(line, '#')) != NULL) *word = '\0';
+    word = strtok(line, " \t\r\n");
+    if (word == NULL) continue;
+    arg = strtok(NULL, " \t\r\n");
+    if (!strcmp(word, "macro") && ((arg == NULL) || (strtok(NULL, " \t\r\n") == NULL))) {
+      if (*count > 0) size++;   /* End of the one before. */
+      if (++*count > MACRO_COUNT) {
+        fprintf(stderr, "%s:%d: more than %d macros\n", path, lineno, MACRO_COUNT);
+        fclose(f);
+        return 1;
+      }
+      if (arg == NULL) continue;
+      if ((parse_hex(arg) >= 0) || (find_macro(arg) >= 0) ||
+          (strlen(arg) >= sizeof(macro_names[0]))) {
+        fprintf(stderr, "%s:%d: macro name is a hex code, taken or too long\n", path, lineno);
+        fclose(f);
+        return 1;
+      }
+      strcpy(macro_names[*count - 1], arg);
+      continue;
+    }
+    for (i = 0; i < countof(steps); i++) {
+      if (!strcmp(word, steps[i].name)) break;
+    }
+    value = ULONG_MAX;
+    if ((i < countof(steps)) && (arg != NULL) && (strtok(NULL, " \t\r\n") == NULL)) {
+      value = strtoul(arg, &rest, steps[i].base);
+      if (*rest != '\0') value = ULONG_MAX;
+    }
+    if ((value > 0xFF) || (*count == 0)) {
+      fprintf(stderr, "%s:%d: expected macro, press, release, tap or wait\n", path, lineno);
+      fclose(f);
+      return 1;
+    }
+    if (size + 3 > MACRO_BYTES) {
+      fprintf(stderr, "%s:%d: macros are over %d bytes\n", path, lineno, MACRO_BYTES);
+      fclose(f);
+      return 1;
+    }
+    macros[size++] = steps[i].step;
+    macros[size++] = value;
+  }
+  fclose(f);
+  return 0;
+}
+
+static int table_command(int fd, int report, int command, int offset, const unsigned char *piece)
+{
+  unsigned char buf[1 + 2 + TABLE_PIECE_SIZE];
+
+  memset(buf, 0, sizeof(buf));
+  buf[0] = report;
+  buf[1] = command;
+  buf[2] = offset;
+  if (piece != NULL) {
+    memcpy(buf + 3, piece, TABLE_PIECE_SIZE);
+  }
+  if (ioctl(fd, HIDIOCSFEATURE(sizeof(buf)), buf) < 0) {
+    perror("Error setting table report");
+    return -1;
+  }
+  return 0;
+}
+
+/* Returns 1 if the keyboard has the table in use, 0 if not, or -1 on error. */
+static int check_table(int fd, int report, const unsigned char *table, int size)
+{
+  unsigned char buf[1 + 2 + TABLE_PIECE_SIZE];
+  int rc;
+
+  for (int offset = 0; offset < size; offset += TABLE_PIECE_SIZE) {
+    if (table_command(fd, report, TABLE_COMMAND_READ, offset, NULL) < 0) return -1;
+    buf[0] = report;
+    rc = ioctl(fd, HIDIOCGFEATURE(sizeof(buf)), buf);
+    if (rc < 0) {
+      perror("Error getting table report");
+      return -1;
+    }
+    if (rc != sizeof(buf)) {
+      fprintf(stderr, "Incorrect table report: %d", rc);
+      return -1;
+    }
+    if ((buf[2] != offset) || memcmp(buf + 3, table + offset, TABLE_PIECE_SIZE)) return 0;
+  }
+  return 1;
+}
+
+/* Upload a table and swap it in. Returns 0 once the keyboard has it in use. */
+static int load_table(int fd, int report, const unsigned char *table, int size)
+{
+  int rc;
+
+  if (table_command(fd, report, TABLE_COMMAND_BEGIN, 0, NULL) < 0) return 1;
+  for (int offset = 0; offset < size; offset += TABLE_PIECE_SIZE) {
+    if (table_command(fd, report, TABLE_COMMAND_LOAD, offset, table + offset) < 0) return 1;
+  }
+  for (int i = 0; i < TABLE_SWAP_TRIES; i++) {
+    if (table_command(fd, report, TABLE_COMMAND_SWAP, 0, NULL) < 0) return 1;
+    rc = check_table(fd, report, table, size);
+    if (rc < 0) return 1;
+    if (rc > 0) return 0;
+    usleep(100000);
+  }
+  fprintf(stderr, "Keyboard did not take the table.\n");
+  return 1;
+}
+
+static int load_map(int fd, const unsigned char *map)
+{
+  int count = 0;
+
+  if (load_table(fd, REPORT_ID_REMAP, map, REMAP_KEYS)) return 1;
+  for (int key = 0; key < REMAP_KEYS; key++) {
+    if (map[key] != 0) count++;
+  }
+  printf("Key map = %d keys remapped\n", count);
+  return 0;
+}
+
+static int load_macros(int fd, const unsigned char *macros, int count)
+{
+  if (load_table(fd, REPORT_ID_MACROS, macros, MACRO_BYTES)) return 1;
+  if (count == 0) {
+    printf("Macros = none\n");
+  }
+  else {
+    printf("Macros = %d, codes %02X to %02X\n", count, MACRO_FIRST, MACRO_FIRST + count - 1);
+  }
+  return 0;
+}
+
 int main(int argc, char **argv)
 {
   while (true) {
     int option_index = 0;
-    int c = getopt_long(argc, argv, "d:cn",
+    int c = getopt_long(argc, argv, "d:cnp:",
                         long_options, &option_index);
 
     if (c < 0) break;
@@ -110,195 +515,92 @@ int main(int argc, char **argv)
       click = 0;
       break;
 
+    case 'p':
+      poll_interval = atoi(optarg);
+      if (poll_interval < 1 || poll_interval > 254) {
+        fprintf(stderr, "Polling interval must be between 1 and 254 ms.\n");
+        return 1;
+      }
+      break;
+
+    case 't':
+      tap_time = atoi(optarg);
+      if (tap_time < 0 || tap_time > 254) {
+        fprintf(stderr, "Tap time must be between 1 and 254 ms, or 0 for the default.\n");
+        return 1;
+      }
+      break;
+
+    case 'm':
+      map_file = optarg;
+      break;
+
+    case 'M':
+      macro_file = optarg;
+      break;
+
     case '?':
     default:
-      printf("Usage: %s [--device num] [--click] [--no-click]\n", argv[0]);
+      printf("Usage: %s [--device num] [--click] [--no-click] [--poll ms] [--tap-time ms] [--latency] [--clear-latency] [--stats] [--clear-stats] [--load-map file] [--load-macros file]\n", argv[0]);
       return 1;
     }
   }
 
-  if (device[0] == '\0') {
-    if (!find_sunkbd(device)) return 1;
+  /* Macros first, so that the map can bind keys to them by name. */
+  unsigned char map[REMAP_KEYS], macros[MACRO_BYTES];
+  int macro_count = 0;
+  if (macro_file && read_macros(macro_file, macros, &macro_count)) return 1;
+  if (map_file && read_map(map_file, map)) return 1;
+
+  bool found = (device[0] == '\0');
+  if (found) {
+    if (!find_sunkbd(device, true)) return 1;
   }
 
   int fd, rc;
-  unsigned char buf[3];
+  unsigned char buf[5];
   fd = open(device, O_RDWR|O_NONBLOCK);
   if (fd < 0) {
     perror("Unable to open device");
     return 1;
   }
   
-  buf[0] = 0;
-  rc = ioctl(fd, HIDIOCGFEATURE(3), buf);
+  buf[0] = REPORT_ID_SETTINGS;
+  rc = ioctl(fd, HIDIOCGFEATURE(sizeof(buf)), buf);
   if (rc < 0) {
     perror("Error getting feature report");
     return 1;
   }
-  if (rc != 3) {
+  if (rc != sizeof(buf)) {
     fprintf(stderr, "Incorrect feature report: %d", rc);
     return 1;
   }
 
-  // http://docs.oracle.com/cd/E19253-01/817-2521/new-311/index.html#indexterm-82
-  // Changing Between Keyboards on SPARC Systems
-
-  const char *layout;
-  switch (buf[1]) {
-  case 0x00:
-  case 0x01:
-    layout = "Type 4 / United States";
-    break;
-  case 0x02:
-    layout = "Type 4 / Belgium / French";
-    break;
-  case 0x03:
-    layout = "Type 4 / Canada / French";
-    break;
-  case 0x04:
-    layout = "Type 4 / Denmark";
-    break;
-  case 0x05:
-    layout = "Type 4 / Germany";
-    break;
-  case 0x06:
-    layout = "Type 4 / Italy";
-    break;
-  case 0x07:
-    layout = "Type 4 / Netherlands";
-    break;
-  case 0x08:
-    layout = "Type 4 / Norway";
-    break;
-  case 0x09:
-    layout = "Type 4 / Portugal";
-    break;
-  case 0x0A:
-    layout = "Type 4 / America / Spanish";
-    break;
-  case 0x0B:
-    layout = "Type 4 / Sweden, Finland";
-    break;
-  case 0x0C:
-    layout = "Type 4 / Switzerland / French";
-    break;
-  case 0x0D:
-    layout = "Type 4 / Switzerland / German";
-    break;
-  case 0x0E:
-    layout = "Type 4 / Great Britain";
-    break;
-  case 0x10:
-    layout = "Type 4 / Korea";
-    break;
-  case 0x11:
-    layout = "Type 4 / Taiwan";
-    break;
-  case 0x17:
-    layout = "Type 4 / Russia";
-    break;
-  case 0x21:
-    layout = "Type 5 / United States";
-    break;
-  case 0x22:
-    layout = "Type 5 / United States / UNIX";
-    break;
-  case 0x23:
-    layout = "Type 5 / France";
-    break;
-  case 0x24:
-    layout = "Type 5 / Denmark";
-    break;
-  case 0x25:
-    layout = "Type 5 / Germany";
-    break;
-  case 0x26:
-    layout = "Type 5 / Italy";
-    break;
-  case 0x27:
-    layout = "Type 5 / Netherlands";
-    break;
-  case 0x28:
-    layout = "Type 5 / Norway";
-    break;
-  case 0x29:
-    layout = "Type 5 / Portugal";
-    break;
-  case 0x2A:
-    layout = "Type 5 / Spain";
-    break;
-  case 0x2B:
-    layout = "Type 5 / Sweden";
-    break;
-  case 0x2C:
-    layout = "Type 5 / Switzerland / French";
-    break;
-  case 0x2D:
-    layout = "Type 5 / Switzerland / German";
-    break;
-  case 0x2E:
-    layout = "Type 5 / Great Britain";
-    break;
-  case 0x2F:
-    layout = "Type 5 / Korea";
-    break;
-  case 0x30:
-    layout = "Type 5 / Taiwan";
-    break;
-  case 0x31:
-    layout = "Type 5 / Japan";
-    break;
-  case 0x32:
-    layout = "Type 5 / Canada / French";
-    break;
-  case 0x33:
-    layout = "Type 5 / Hungary";
-    break;
-  case 0x34:
-    layout = "Type 5 / Poland";
-    break;
-  case 0x35:
-    layout = "Type 5 / Czech";
-    break;
-  case 0x36:
-    layout = "Type 5 / Russia";
-    break;
-  case 0x37:
-    layout = "Type 5 / Latvia";
-    break;
-  case 0x38:
-    layout = "Type 5 / Turkey";
-    break;
-  case 0x39:
-    layout = "Type 5 / Greece";
-    break;
-  case 0x3A:
-    layout = "Type 5 / Arabic";
-    break;
-  case 0x3B:
-    layout = "Type 5 / Lithuania";
-    break;
-  case 0x3C:
-    layout = "Type 5 / Belgium";
-    break;
-  case 0x3E:
-    layout = "Type 5 / Canada / French";
-    break;
-  default:
-    layout = "Unknown";
-    break;
+  const char *layout = "Unknown";
+  for (size_t i = 0; i < countof(layout_names); i++) {
+    if (layout_names[i].code == buf[1]) {
+      layout = layout_names[i].name;
+      break;
+    }
   }
   printf("Layout = %02X (%s)\n", buf[1], layout);
 
+  bool reconnect = (poll_interval != -1) && (poll_interval != buf[3]);
   do {
+    if (click == -1 && poll_interval == -1 && tap_time == -1) {
+      break;
+    }
     if (click != -1) {
       buf[2] = (unsigned char)click;
     }
-    else {
-      break;
+    if (poll_interval != -1) {
+      buf[3] = (unsigned char)poll_interval;
+    }
+    if (tap_time != -1) {
+      buf[4] = (unsigned char)tap_time;
     }
 
-    rc = ioctl(fd, HIDIOCSFEATURE(3), buf);
+    rc = ioctl(fd, HIDIOCSFEATURE(sizeof(buf)), buf);
     if (rc < 0) {
       perror("Error setting feature report");
       return 1;
@@ -306,6 +608,23 @@ int main(int argc, char **argv)
   } while(false);
 
   printf("Click = %s\n", buf[2] ? "on" : "off");
+  printf("Polling interval = %d ms%s\n", buf[3],
+         reconnect ? " (keyboard will reconnect)" : "");
+  printf("Tap time = %d ms%s\n",
+         (buf[4] == 0 || buf[4] == 0xFF) ? DEFAULT_TAP_TIME : buf[4],
+         (buf[4] == 0 || buf[4] == 0xFF) ? " (default)" : "");
+
+  if (reconnect && (latency || clear_latency || stats || clear_stats || macro_file || map_file)) {
+    fd = reopen_device(fd, device, found);
+    if (fd < 0) return 1;
+  }
+
+  if (latency && show_latency(fd)) return 1;
+  if (clear_latency && reset_latency(fd)) return 1;
+  if (stats && show_stats(fd)) return 1;
+  if (clear_stats && reset_stats(fd)) return 1;
+  if (macro_file && load_macros(fd, macros, macro_count)) return 1;
+  if (map_file && load_map(fd, map)) return 1;
 
   return 0;
 }